@@ -11,7 +11,6 @@ protected:
 	using vmxtype = std::vector<mxtype>;
 	using sztype = size_t;
 	using vsztype = std::valarray<sztype>;
-private:
 	vmxtype weight, bias;
 	vsztype size; // 神经元层大小（包括输入层、输出层和隐藏层）
 	std::function<mxtype(const mxtype&)> activatef; // 激活函数
@@ -20,6 +19,47 @@ private:
 	std::function<vmxtype(const vsztype&)> binitf; // 偏置初始化函数
 	std::function<_Value(const mxtype&, const mxtype&)> lossf; // 损失函数/代价函数
 	std::function<std::valarray<_Value>(const mxtype&, const mxtype&)> dlossf; // 损失函数的导数/偏导
+	// 参数版本：构造、复制和每次改变参数时都从全局计数器取一个新值，所以不同的模型（包括副本）不会有相同的版本，
+	// 推理缓存以它区分模型并判断结果是否过期
+	unsigned long long version = next_version();
+
+	static unsigned long long next_version()
+	{
+		static std::atomic<unsigned long long> counter{ 0 };
+		return ++counter;
+	}
+	void bump_version() { version = next_version(); }
+
+	// dense 为 true 时权重取 o.export_weight()，否则原样复制（供子类复制同类对象时使用）
+	void copy_from(const MLP& o, bool dense)
+	{
+		if (dense) o.export_weight_to(weight);
+		else weight = o.weight;
+		bias = o.bias;
+		size = o.size;
+		activatef = o.activatef;
+		dactivatef = o.dactivatef;
+		winitf = o.winitf;
+		binitf = o.binitf;
+		lossf = o.lossf;
+		dlossf = o.dlossf;
+		bump_version();
+	}
+	struct shallow_copy_t {};
+	// 原样复制权重（供子类复制同类对象时使用）
+	MLP(const MLP& o, shallow_copy_t) { copy_from(o, false); }
+
+	// 每一层权重的计算。稀疏、低秩等存储方式不同的子类只覆盖这几个函数，get、train、apply_train 的其余部分共用
+	// weight[i] * x
+	virtual mxtype layer_mul(size_t i, const mxtype& x) const { return weight[i] * x; }
+	// rotate(weight[i]) * x
+	virtual mxtype layer_tmul(size_t i, const mxtype& x) const { return rotate(weight[i]) * x; }
+	// 第 i 层权重的梯度写入 dw，ae 为 dL/dz[i]，a 为上一层的输出 a[i - 1]
+	virtual void layer_grad(size_t i, const mxtype& ae, const mxtype& a, vmxtype& dw) const { dw[i] = ae * rotate(a); }
+	// 按 dw 更新第 i 层的权重
+	virtual void layer_apply(size_t i, const _Value& beta, const vmxtype& dw) { weight[i] -= beta * dw[i]; }
+	// train 返回的 dw 的长度
+	virtual size_t grad_count() const { return size.size(); }
 public:
 	MLP(const vsztype& sz, // 大小
 		decltype(activatef) acf = [](const mxtype& in) { return activate_func::Leaky_PReLU(in, 0.01); },
@@ -41,7 +81,14 @@ public:
 		weight = winitf(sz);
 		bias = binitf(sz);
 	}
-	virtual vmxtype get(const mxtype& in)
+	// 复制时权重取稠密形式，所以把子类（如 lowrank_MLP）复制成 MLP 得到的仍是完整的网络
+	MLP(const MLP& o) { copy_from(o, true); }
+	MLP& operator=(const MLP& o)
+	{
+		if (this != &o) copy_from(o, true);
+		return *this;
+	}
+	virtual vmxtype get(const mxtype& in) const
 	{
 		// Argument Check
 		if (in.size().second != 1) throw std::invalid_argument("Error in MLP::get: The column number of the input matrix should be 1 (The matrix should be a column vector).");
@@ -51,7 +98,7 @@ public:
 		a.push_back(in);
 		for (unsigned i = 1; i < size.size(); i++)
 		{
-			a.push_back(activatef(weight[i] * a.back() + bias[i]));
+			a.push_back(activatef(layer_mul(i, a.back()) + bias[i]));
 		}
 		return a;
 	}
@@ -73,22 +120,22 @@ public:
 		z.push_back(in);
 		for (unsigned i = 1; i < size.size(); i++)
 		{
-			z.push_back(weight[i] * a.back() + bias[i]);
+			z.push_back(layer_mul(i, a.back()) + bias[i]);
 			a.push_back(activatef(z.back()));
 		}
 		_Value loss = lossf(a.back(), out);
 		// æ
 		decltype(a) dw, db, da, ae;
-		dw.resize(a.size());
+		dw.resize(grad_count());
 		da.resize(a.size());
 		db.resize(a.size());
 		ae.resize(a.size());
 		da.back() = dlossf(a.back(), out);
 		for (unsigned i = a.size() - 1; i >= 1; i--)
 		{
-			if (i + 1 != a.size()) da[i] = rotate(weight[i + 1]) * ae[i + 1];
+			if (i + 1 != a.size()) da[i] = layer_tmul(i + 1, ae[i + 1]);
 			ae[i] = dot_p(da[i], dactivatef(z[i]));
-			dw[i] = ae[i] * rotate(a[i - 1]);
+			layer_grad(i, ae[i], a[i - 1], dw);
 			db[i] = da[i];
 		}
 		return { loss, dw, db, da };
@@ -101,11 +148,13 @@ public:
 	/// <param name="db">delta b</param>
 	virtual void apply_train(const _Value& beta, const decltype(weight)& dw, const decltype(bias)& db)
 	{
+		if (dw.size() != grad_count() || db.size() != bias.size()) throw std::length_error("Error in MLP::apply_train: The length of dw or db does not match the result of train.");
 		for (unsigned i = 1; i < size.size(); i++)
 		{
-			weight[i] -= beta * dw[i];
+			layer_apply(i, beta, dw);
 			bias[i] -= beta * db[i];
 		}
+		bump_version();
 	}
 	virtual _Value train_and_apply(const _Value& beta, const type_matrix<_Value>& in, const type_matrix<_Value>& out)
 	{
@@ -126,6 +175,47 @@ public:
 	{
 		activatef = acf;
 		dactivatef = dacf;
+		bump_version();
+	}
+	// 只读访问参数，供 static_mlp 等其它实现导入权重
+	const vmxtype& get_weight() const { return weight; }
+	const vmxtype& get_bias() const { return bias; }
+	const vsztype& get_size() const { return size; }
+	unsigned long long get_version() const { return version; }
+	// 把稠密形式的权重写入 w，形状不变时不重新分配内存
+	// 子类中不以稠密矩阵保存的层（如 lowrank_MLP 的低秩层）也会展开成稠密矩阵，转换成其它模型（static_mlp、MLP_ensemble 等）时使用；
+	// 检查点用 export_params
+	virtual void export_weight_to(vmxtype& w) const
+	{
+		if (w.size() != weight.size()) w.resize(weight.size());
+		for (size_t i = 0; i < weight.size(); i++) w[i] = weight[i];
+	}
+	vmxtype export_weight() const { vmxtype w; export_weight_to(w); return w; }
+	// 保存/恢复模型自己的参数（检查点用）：子类按自己的存储方式保存，恢复后与保存时完全相同
+	// export_params 把参数追加到 buf 末尾，只复制数据；import_params 在格式或大小不符时抛出异常，且不修改模型
+	virtual void export_params(std::string& buf) const
+	{
+		binary_io::put_string(buf, "MLP");
+		binary_io::put_matrices(buf, weight);
+		binary_io::put_matrices(buf, bias);
+	}
+	virtual void import_params(binary_io::reader& rd)
+	{
+		vmxtype w, b;
+		if (!rd.expect("MLP") || !rd.get_matrices(w) || !rd.get_matrices(b)) throw std::invalid_argument("Error in MLP::import_params: The data is not the parameters of an MLP.");
+		MLP::set_param(w, b);
+	}
+	// 整体替换参数（如从检查点恢复），每一层的大小必须与原来一致
+	virtual void set_param(const vmxtype& w, const vmxtype& b)
+	{
+		if (w.size() != weight.size() || b.size() != bias.size()) throw std::length_error("Error in MLP::set_param: The number of layers of w and b should equals to the MLP.");
+		for (unsigned i = 0; i < size.size(); i++)
+		{
+			if (w[i].size() != weight[i].size() || b[i].size() != bias[i].size()) throw std::invalid_argument("Error in MLP::set_param: The size of layer " + std::to_string(i) + " of w or b does not match the MLP.");
+		}
+		weight = w;
+		bias = b;
+		bump_version();
 	}
 	virtual ~MLP() {};
 };
\ No newline at end of file
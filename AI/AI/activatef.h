@@ -112,6 +112,40 @@ namespace activate_func
 	template<typename _Valt>
 	auto d_mish(const _Valt& x) { return forall(x, [](const auto& xx) { return d_tanh(softplus(xx)) * d_softplus(xx) + tanh(softplus(xx)); }); }
 
+	// 函数对象版本（逐元素标量），供 static_mlp 等固定结构的网络直接内联，不经过 std::function
+	// operator() 为激活函数本身，d() 为其导数
+	template<typename _Valt>
+	struct identity_f
+	{
+		_Valt operator()(const _Valt& x) const { return x; }
+		_Valt d(const _Valt&) const { return 1; }
+	};
+	template<typename _Valt>
+	struct ReLU_f
+	{
+		_Valt operator()(const _Valt& x) const { return x > 0 ? x : 0; }
+		_Valt d(const _Valt& x) const { return x > 0 ? 1 : 0; }
+	};
+	template<typename _Valt>
+	struct Leaky_PReLU_f
+	{
+		_Valt a = 0.01;
+		_Valt operator()(const _Valt& x) const { return x > 0 ? x : a * x; }
+		_Valt d(const _Valt& x) const { return x > 0 ? 1 : a; }
+	};
+	template<typename _Valt>
+	struct sigmoid_f
+	{
+		_Valt operator()(const _Valt& x) const { return sigmoid(x); }
+		_Valt d(const _Valt& x) const { return d_sigmoid(x); }
+	};
+	template<typename _Valt>
+	struct tanh_f
+	{
+		_Valt operator()(const _Valt& x) const { return activate_func::tanh(x); }
+		_Valt d(const _Valt& x) const { return d_tanh(x); }
+	};
+
 	// AconC/MetaAconC
 	template<typename _Valt, typename _At = _Valt>
 	auto AconC(const _Valt& x, const _At& a) { return forall(x, [&](const auto& xx) { return 1 / (exp(-1 * a * xx) + 1); }); };
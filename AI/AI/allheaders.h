@@ -4,6 +4,7 @@
 #include <vector>
 #include <random>
 #include <chrono>
+#include <atomic>
 #include <utility>
 #include <valarray>
 #include <stdexcept>
@@ -14,4 +15,5 @@
 #include "initf.h"
 #include "lossf.h"
 #include "matrix.h"
-#include "activatef.h"
\ No newline at end of file
+#include "activatef.h"
+#include "serialize.h"
\ No newline at end of file
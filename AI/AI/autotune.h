@@ -0,0 +1,218 @@
+#pragma once
+#include <set>
+#include <tuple>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <filesystem>
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#include "MLP.h"
+
+// 矩阵乘法核的自动调优
+// 对 MLP 实际用到的每个乘法形状，逐个调整 gemm_params 的各项参数（坐标下降），实测选出最快的一组，
+// 写入 matrix_config().tuned，并保存到缓存文件（按 CPU 型号、线程数和形状区分），下次启动直接读取，不再重新调优。
+// 调优结果只对测量时的线程数有效，set_threads 改变线程数后 gemm_for 不再使用它们，需要重新调用 tune。
+namespace autotune
+{
+	// 当前 CPU 的型号
+	inline std::string cpu_model()
+	{
+#ifdef _WIN32
+		int info[4];
+		char brand[49] = {};
+		__cpuid(info, 0x80000000);
+		if (unsigned(info[0]) >= 0x80000004)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				__cpuid(info, 0x80000002 + i);
+				std::memcpy(brand + i * 16, info, 16);
+			}
+		}
+		std::string res = brand;
+#else
+		std::string res;
+		std::ifstream fin("/proc/cpuinfo");
+		std::string line;
+		while (std::getline(fin, line))
+		{
+			if (line.rfind("model name", 0) == 0 && line.find(':') != std::string::npos) { res = line.substr(line.find(':') + 1); break; }
+		}
+#endif
+		// 去掉首尾空白，制表符是缓存文件的分隔符
+		for (auto& c : res) if (c == '\t') c = ' ';
+		res.erase(0, res.find_first_not_of(' '));
+		res.erase(res.find_last_not_of(' ') + 1);
+		return res.empty() ? "unknown" : res;
+	}
+
+	// 线程数与 tuned 测量时不同，则丢弃旧的调优结果
+	inline void sync_threads()
+	{
+		auto& cfg = matrix_config();
+		size_t t = thread_pool::global().size();
+		if (cfg.tuned_threads == t) return;
+		cfg.tuned.clear();
+		cfg.tuned_threads = t;
+	}
+
+	// MLP 的 get 和 train 中用到的所有矩阵乘法形状
+	template<typename _Value>
+	std::vector<gemm_shape> mlp_shapes(const MLP<_Value>& mlp)
+	{
+		const auto& sz = mlp.get_size();
+		std::set<std::tuple<size_t, size_t, size_t>> st;
+		for (size_t i = 1; i < sz.size(); i++)
+		{
+			st.insert({ sz[i], sz[i - 1], 1 }); // weight[i] * a[i - 1]
+			st.insert({ sz[i - 1], sz[i], 1 }); // rotate(weight[i]) * ae[i]
+			st.insert({ sz[i], 1, sz[i - 1] }); // ae[i] * rotate(a[i - 1])
+		}
+		std::vector<gemm_shape> res;
+		for (auto [n, m, p] : st) res.push_back({ n, m, p, sizeof(_Value) });
+		return res;
+	}
+
+	// 用参数 g 计算 s 形状的乘法，返回平均每次耗时（纳秒）
+	template<typename _Value>
+	double benchmark(const gemm_shape& s, const gemm_params& g)
+	{
+		std::mt19937_64 mt(s.n * 1000003 + s.m * 1009 + s.p);
+		std::uniform_real_distribution<double> u(-1, 1);
+		type_matrix<_Value> x(s.n, s.m), y(s.m, s.p);
+		for (auto& q : x) q = _Value(u(mt));
+		for (auto& q : y) q = _Value(u(mt));
+		sync_threads();
+		auto& cfg = matrix_config();
+		auto old = cfg.tuned.find(s) == cfg.tuned.end() ? std::optional<gemm_params>() : cfg.tuned[s];
+		cfg.tuned[s] = g;
+		// 每轮至少跑 1ms，取 3 轮中最快的一次
+		double best = 1e300;
+		size_t repeat = 1;
+		for (int round = 0; round < 3; )
+		{
+			auto st = std::chrono::steady_clock::now();
+			for (size_t r = 0; r < repeat; r++) { auto z = x * y; (void)z; }
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - st).count();
+			if (ns < 1e6 && repeat < (1u << 20)) { repeat *= 2; continue; }
+			best = std::min(best, ns / repeat);
+			round++;
+		}
+		if (old) cfg.tuned[s] = *old;
+		else cfg.tuned.erase(s);
+		return best;
+	}
+
+	// 对一个形状调优：从默认参数出发，依次调整每一项，保留更快的取值
+	template<typename _Value>
+	gemm_params tune_shape(const gemm_shape& s)
+	{
+		gemm_params best = matrix_config().gemm;
+		double best_ns = benchmark<_Value>(s, best);
+		auto attempt = [&](gemm_params g) {
+			if (g == best) return;
+			double ns = benchmark<_Value>(s, g);
+			if (ns < best_ns) { best_ns = ns; best = g; }
+		};
+		// 串行或并行（只有一个线程时没有必要比较）
+		if (thread_pool::global().size() > 1)
+		{
+			gemm_params g = best;
+			g.threshold = best.threshold > s.n * s.m * s.p ? 0 : SIZE_MAX;
+			attempt(g);
+		}
+		for (size_t t : { 16, 32, 64, 128, 256 }) { gemm_params g = best; g.tile = t; attempt(g); }
+		for (size_t k : { 32, 64, 128, 256, 1024 }) { gemm_params g = best; g.kblock = k; attempt(g); }
+		for (size_t u : { 1, 2, 4, 8 }) { gemm_params g = best; g.unroll = u; attempt(g); }
+		{ gemm_params g = best; g.packed = !g.packed; attempt(g); }
+		return best;
+	}
+
+	// 缓存文件中的一行：CPU 型号 \t 线程数 \t n m p elem \t tile kblock unroll threshold packed
+	inline std::string format_entry(const std::string& cpu, size_t threads, const gemm_shape& s, const gemm_params& g)
+	{
+		std::ostringstream os;
+		os << cpu << '\t' << threads << '\t' << s.n << ' ' << s.m << ' ' << s.p << ' ' << s.elem << '\t' << g.tile << ' ' << g.kblock << ' ' << g.unroll << ' ' << g.threshold << ' ' << g.packed;
+		return os.str();
+	}
+	inline bool parse_entry(const std::string& line, std::string& cpu, size_t& threads, gemm_shape& s, gemm_params& g)
+	{
+		auto a = line.find('\t'), b = line.find('\t', a + 1), c = line.find('\t', b + 1);
+		if (a == std::string::npos || b == std::string::npos || c == std::string::npos) return false;
+		cpu = line.substr(0, a);
+		std::istringstream ts(line.substr(a + 1, b - a - 1)), ss(line.substr(b + 1, c - b - 1)), gs(line.substr(c + 1));
+		return bool(ts >> threads) && bool(ss >> s.n >> s.m >> s.p >> s.elem) && bool(gs >> g.tile >> g.kblock >> g.unroll >> g.threshold >> g.packed);
+	}
+
+	// 读取缓存文件中属于当前 CPU 和线程数的调优结果，返回读到的条数；文件不存在时返回 0
+	inline size_t load(const std::string& path)
+	{
+		sync_threads();
+		std::ifstream fin(path);
+		std::string cpu = cpu_model(), line, c;
+		size_t threads = matrix_config().tuned_threads, t, cnt = 0;
+		while (std::getline(fin, line))
+		{
+			gemm_shape s;
+			gemm_params g;
+			if (parse_entry(line, c, t, s, g) && c == cpu && t == threads) { matrix_config().tuned[s] = g; cnt++; }
+		}
+		return cnt;
+	}
+	// 把当前 CPU 和线程数的调优结果写入缓存文件，保留其它 CPU 或线程数的记录
+	inline void save(const std::string& path)
+	{
+		std::string cpu = cpu_model(), line, c;
+		size_t threads = matrix_config().tuned_threads, t;
+		std::vector<std::string> keep;
+		{
+			std::ifstream fin(path);
+			while (std::getline(fin, line))
+			{
+				gemm_shape s;
+				gemm_params g;
+				if (parse_entry(line, c, t, s, g) && (c != cpu || t != threads)) keep.push_back(line);
+			}
+		}
+		for (const auto& [s, g] : matrix_config().tuned) keep.push_back(format_entry(cpu, threads, s, g));
+		// 先写临时文件再改名，中途退出也不会留下半个缓存文件
+		std::string tmp = path + ".tmp";
+		{
+			std::ofstream fout(tmp, std::ios::trunc);
+			if (!fout) throw std::runtime_error("Error in autotune::save: Cannot open the file " + tmp + ".");
+			for (const auto& l : keep) fout << l << '\n';
+		}
+		std::filesystem::rename(tmp, path);
+	}
+
+	/// <summary>
+	/// 为 MLP 用到的乘法形状调优。缓存中已有的形状直接使用，其余的实测后写回缓存
+	/// </summary>
+	/// <param name="mlp">要调优的网络（只用到它的层大小）</param>
+	/// <param name="path">缓存文件，为空则不读写缓存</param>
+	/// <returns>本次实际调优（未命中缓存）的形状个数</returns>
+	template<typename _Value>
+	size_t tune(const MLP<_Value>& mlp, const std::string& path = "tiny_mlp_tuning.cache")
+	{
+		sync_threads();
+		if (!path.empty()) load(path);
+		size_t cnt = 0;
+		for (const auto& s : mlp_shapes(mlp))
+		{
+			if (matrix_config().tuned.count(s)) continue;
+			matrix_config().tuned[s] = tune_shape<_Value>(s);
+			cnt++;
+		}
+		if (cnt && !path.empty()) save(path);
+		return cnt;
+	}
+}
@@ -0,0 +1,274 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <condition_variable>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "MLP.h"
+
+// 训练状态：参数以外需要保存的东西（优化器状态）
+template<typename _Value = long double>
+struct train_state
+{
+	unsigned long long step = 0; // 已经 apply_train 的次数
+	_Value beta = 0; // 学习率
+	std::vector<type_matrix<_Value>> extra; // 其它优化器状态（如动量），没有就留空
+};
+
+// 异步训练检查点
+// snapshot 只把模型自己的参数（export_params：稠密层的 weight、低秩层的 U 和 V 等）原样复制到两个缓冲区中空闲的一个，然后立即返回；
+// 后台线程负责序列化、写文件、fsync，并只保留最近 keep 个检查点。
+// 写到一半的文件不会被当作检查点：先写临时文件，fsync 后再改名，文件末尾还有校验和。
+// 每个 checkpointer 是一次运行（run），编号比目录中已有的都大，文件名为 ckpt_<run>_<step>.bin；
+// 轮换只在本次运行的检查点中进行，不会删除之前的运行留下的文件，load_latest 优先从编号最大的运行中恢复。
+template<typename _Value = long double>
+class checkpointer
+{
+private:
+	using mxtype = type_matrix<_Value>;
+	using vmxtype = std::vector<mxtype>;
+	struct slot
+	{
+		std::string params; // export_params 的结果
+		train_state<_Value> st;
+	};
+	static constexpr char magic[9] = "TMLPCKP2";
+	std::filesystem::path dir;
+	size_t keep;
+	unsigned long long run; // 本次运行的编号
+	slot slots[2];
+	int pending = -1, writing = -1; // 等待写入/正在写入的缓冲区，-1 表示没有
+	bool stop = false;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::atomic<size_t> written{ 0 }, replaced{ 0 };
+	std::string error; // 最近一次写入失败的原因
+	std::thread writer;
+
+	// 形状相同时逐个赋值，valarray 不会重新分配内存
+	static void copy_into(vmxtype& dst, const vmxtype& src)
+	{
+		if (dst.size() != src.size()) { dst = src; return; }
+		for (size_t i = 0; i < src.size(); i++) dst[i] = src[i];
+	}
+	static uint64_t fnv1a(const std::string& s)
+	{
+		uint64_t h = 1469598103934665603ull;
+		for (unsigned char c : s) { h ^= c; h *= 1099511628211ull; }
+		return h;
+	}
+	static std::string serialize(const slot& sl)
+	{
+		std::string buf(magic, 8);
+		binary_io::put<uint32_t>(buf, sizeof(_Value));
+		binary_io::put<uint64_t>(buf, sl.st.step);
+		binary_io::put<_Value>(buf, sl.st.beta);
+		binary_io::put_string(buf, sl.params);
+		binary_io::put_matrices(buf, sl.st.extra);
+		binary_io::put<uint64_t>(buf, fnv1a(buf));
+		return buf;
+	}
+	static bool deserialize(const std::string& buf, slot& sl)
+	{
+		if (buf.size() < 8 + sizeof(uint64_t) || buf.compare(0, 8, magic) != 0) return false;
+		uint64_t sum;
+		std::memcpy(&sum, buf.data() + buf.size() - sizeof(uint64_t), sizeof(uint64_t));
+		std::string body = buf.substr(0, buf.size() - sizeof(uint64_t));
+		if (fnv1a(body) != sum) return false;
+		binary_io::reader rd{ body, 8 };
+		uint32_t vsz;
+		return rd.get(vsz) && vsz == sizeof(_Value) && rd.get(sl.st.step) && rd.get(sl.st.beta)
+			&& rd.get_string(sl.params) && rd.get_matrices(sl.st.extra) && rd.pos == body.size();
+	}
+	static std::string file_name(unsigned long long r, unsigned long long step)
+	{
+		char name[64];
+		std::snprintf(name, sizeof(name), "ckpt_%010llu_%020llu.bin", r, step);
+		return name;
+	}
+	// 文件名中的运行编号
+	static unsigned long long run_of(const std::filesystem::path& p) { return std::stoull(p.filename().string().substr(5, 10)); }
+	// 目录下所有检查点文件，按运行编号、再按 step 从小到大
+	static std::vector<std::filesystem::path> list(const std::filesystem::path& d)
+	{
+		std::vector<std::filesystem::path> res;
+		std::error_code ec;
+		for (const auto& e : std::filesystem::directory_iterator(d, ec))
+		{
+			auto name = e.path().filename().string();
+			if (name.size() == 40 && name.rfind("ckpt_", 0) == 0 && name[15] == '_' && e.path().extension() == ".bin"
+				&& std::all_of(name.begin() + 5, name.begin() + 15, ::isdigit)) res.push_back(e.path());
+		}
+		std::sort(res.begin(), res.end());
+		return res;
+	}
+	static void sync_file(FILE* f)
+	{
+#ifdef _WIN32
+		_commit(_fileno(f));
+#else
+		fsync(fileno(f));
+#endif
+	}
+	static void sync_dir(const std::filesystem::path& d)
+	{
+#ifndef _WIN32
+		int fd = open(d.string().c_str(), O_RDONLY);
+		if (fd >= 0) { fsync(fd); close(fd); }
+#else
+		(void)d;
+#endif
+	}
+	void write(const slot& sl)
+	{
+		std::string buf = serialize(sl);
+		auto tmp = dir / (file_name(run, sl.st.step) + ".tmp");
+		FILE* f = std::fopen(tmp.string().c_str(), "wb");
+		if (f == nullptr) throw std::runtime_error("Error in checkpointer::write: Cannot open the file " + tmp.string() + ".");
+		bool ok = std::fwrite(buf.data(), 1, buf.size(), f) == buf.size() && std::fflush(f) == 0;
+		if (ok) sync_file(f);
+		std::fclose(f);
+		if (!ok) throw std::runtime_error("Error in checkpointer::write: Cannot write the file " + tmp.string() + ".");
+		std::filesystem::rename(tmp, dir / file_name(run, sl.st.step));
+		sync_dir(dir);
+		// 轮换：本次运行只保留最近 keep 个
+		std::vector<std::filesystem::path> mine;
+		for (const auto& p : list(dir)) if (run_of(p) == run) mine.push_back(p);
+		for (size_t i = 0; i + keep < mine.size(); i++) std::filesystem::remove(mine[i]);
+	}
+	void writer_loop()
+	{
+		std::unique_lock<std::mutex> lk(mtx);
+		while (true)
+		{
+			cv.wait(lk, [this] { return stop || pending != -1; });
+			if (pending == -1) return;
+			writing = pending;
+			pending = -1;
+			lk.unlock();
+			try
+			{
+				write(slots[writing]);
+				written++;
+			}
+			catch (const std::exception& e)
+			{
+				lk.lock();
+				error = e.what();
+				lk.unlock();
+			}
+			lk.lock();
+			writing = -1;
+			cv.notify_all();
+		}
+	}
+public:
+	/// <summary>
+	/// 启动后台写入线程
+	/// </summary>
+	/// <param name="directory">检查点目录，不存在则创建</param>
+	/// <param name="keep_count">本次运行保留的检查点个数</param>
+	checkpointer(const std::string& directory, size_t keep_count = 3) : dir(directory), keep(std::max<size_t>(keep_count, 1))
+	{
+		std::filesystem::create_directories(dir);
+		auto all = list(dir);
+		run = all.empty() ? 1 : run_of(all.back()) + 1;
+		writer = std::thread(&checkpointer::writer_loop, this);
+	}
+	checkpointer(const checkpointer&) = delete;
+	checkpointer& operator=(const checkpointer&) = delete;
+	// 写完所有已提交的快照再退出
+	~checkpointer()
+	{
+		{
+			std::lock_guard<std::mutex> lk(mtx);
+			stop = true;
+		}
+		cv.notify_all();
+		writer.join();
+	}
+
+	/// <summary>
+	/// 保存一份快照，在两次 apply_train 之间调用。只复制参数，不等待写盘
+	/// 如果上一份快照还没开始写，它会被这一份替换掉
+	/// </summary>
+	void snapshot(const MLP<_Value>& mlp, const train_state<_Value>& st)
+	{
+		int s;
+		{
+			std::lock_guard<std::mutex> lk(mtx);
+			// 选一个后台线程没在写的缓冲区，优先覆盖还没开始写的那份
+			s = pending != -1 ? pending : (writing == 0 ? 1 : 0);
+			if (pending != -1) replaced++;
+			pending = -1;
+		}
+		slots[s].params.clear(); // 保留容量，大小不变时不重新分配内存
+		mlp.export_params(slots[s].params);
+		slots[s].st.step = st.step;
+		slots[s].st.beta = st.beta;
+		copy_into(slots[s].st.extra, st.extra);
+		{
+			std::lock_guard<std::mutex> lk(mtx);
+			pending = s;
+		}
+		cv.notify_all();
+	}
+	// 等待所有已提交的快照写完
+	void flush()
+	{
+		std::unique_lock<std::mutex> lk(mtx);
+		cv.wait(lk, [this] { return pending == -1 && writing == -1; });
+	}
+	// 本次运行的编号
+	unsigned long long run_id() const { return run; }
+	// 成功写入的检查点个数
+	size_t written_count() const { return written; }
+	// 还没写就被新快照替换掉的个数
+	size_t replaced_count() const { return replaced; }
+	// 最近一次写入失败的原因，没有失败过则为空
+	std::string last_error()
+	{
+		std::lock_guard<std::mutex> lk(mtx);
+		return error;
+	}
+
+	/// <summary>
+	/// 从目录中最新的有效检查点恢复：先找编号最大的运行，其中 step 最大的优先（损坏的、或与模型类型和大小不符的检查点会被跳过）
+	/// </summary>
+	/// <returns>是否找到了有效的检查点</returns>
+	static bool load_latest(const std::string& directory, MLP<_Value>& mlp, train_state<_Value>& st)
+	{
+		auto all = list(directory);
+		for (auto it = all.rbegin(); it != all.rend(); ++it)
+		{
+			FILE* f = std::fopen(it->string().c_str(), "rb");
+			if (f == nullptr) continue;
+			std::string buf;
+			char chunk[1 << 16];
+			size_t len;
+			while ((len = std::fread(chunk, 1, sizeof(chunk), f)) > 0) buf.append(chunk, len);
+			std::fclose(f);
+			slot sl;
+			if (!deserialize(buf, sl)) continue;
+			binary_io::reader rd{ sl.params };
+			try { mlp.import_params(rd); }
+			catch (const std::exception&) { continue; }
+			st = sl.st;
+			return true;
+		}
+		return false;
+	}
+};
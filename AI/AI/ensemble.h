@@ -0,0 +1,297 @@
+#pragma once
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include <numeric>
+#include <valarray>
+#include <algorithm>
+#include "MLP.h"
+
+// 打包训练的一组 MLP（结构相同，初始化种子或学习率不同）
+// K 个模型的同一个参数交错存放：第 i 层权重 (r, c) 在第 k 个模型中的值为 weight[i][(r * m + c) * K + k]，
+// 所以最内层循环总是沿着 k 连续访问，一条向量指令同时推进多个模型，前向和反向传播都是如此。
+// 激活函数为函数对象（见 activate_func::*_f），损失函数固定为 MSE，梯度与 MLP::train 相同。
+template<typename _Value = long double, typename _Act = activate_func::Leaky_PReLU_f<_Value>>
+class MLP_ensemble
+{
+protected:
+	using mxtype = type_matrix<_Value>;
+	using vmxtype = std::vector<mxtype>;
+	using vvtype = std::vector<std::vector<_Value>>;
+	size_t K; // 模型个数
+	std::valarray<size_t> size; // 神经元层大小（包括输入层、输出层和隐藏层）
+	std::valarray<_Value> beta; // 每个模型的学习率
+	std::valarray<_Value> last_loss; // 每个模型最近一次训练的平均损失
+	_Act act;
+	vvtype weight, bias; // 交错存放的参数，下标 0 无意义
+	vvtype dw, db, a, z, da, ae; // 训练时的中间结果，复用以免反复分配
+
+	void alloc()
+	{
+		weight.resize(size.size());
+		bias.resize(size.size());
+		a.resize(size.size());
+		z.resize(size.size());
+		da.resize(size.size());
+		ae.resize(size.size());
+		for (size_t i = 0; i < size.size(); i++)
+		{
+			a[i].assign(size[i] * K, 0);
+			z[i].assign(size[i] * K, 0);
+			da[i].assign(size[i] * K, 0);
+			ae[i].assign(size[i] * K, 0);
+			if (i == 0) continue;
+			weight[i].assign(size[i] * size[i - 1] * K, 0);
+			bias[i].assign(size[i] * K, 0);
+		}
+		dw = weight;
+		db = bias;
+		last_loss.resize(K, 0);
+	}
+	void check_input(const mxtype& in, const char* fun) const
+	{
+		if (in.size() != std::pair<size_t, size_t>(size[0], 1)) throw std::invalid_argument(std::string("Error in MLP_ensemble::") + fun + ": The input matrix should be a column vector with the same rows as the input layer.");
+	}
+	// 前向传播，结果在 a 和 z 中
+	void forward(const mxtype& in)
+	{
+		for (size_t c = 0; c < size[0]; c++)
+		{
+			for (size_t k = 0; k < K; k++) a[0][c * K + k] = in[c][0];
+		}
+		for (size_t i = 1; i < size.size(); i++)
+		{
+			size_t n = size[i], m = size[i - 1];
+			const _Value* w = weight[i].data();
+			const _Value* ap = a[i - 1].data();
+			_Value* zi = z[i].data();
+			std::copy(bias[i].begin(), bias[i].end(), zi);
+			for (size_t r = 0; r < n; r++)
+			{
+				for (size_t c = 0; c < m; c++)
+				{
+					const _Value* wrc = w + (r * m + c) * K;
+					const _Value* apc = ap + c * K;
+					_Value* zr = zi + r * K;
+					for (size_t k = 0; k < K; k++) zr[k] += wrc[k] * apc[k];
+				}
+			}
+			for (size_t j = 0; j < n * K; j++) a[i][j] = act(zi[j]);
+		}
+	}
+	// 反向传播，把梯度累加到 dw 和 db，损失累加到 loss
+	void backward(const mxtype& out, std::valarray<_Value>& loss)
+	{
+		size_t L = size.size() - 1, nl = size[L];
+		if (out.size() != std::pair<size_t, size_t>(nl, 1)) throw std::invalid_argument("Error in MLP_ensemble::train: The output matrix should be a column vector with the same rows as the output layer.");
+		for (size_t r = 0; r < nl; r++)
+		{
+			for (size_t k = 0; k < K; k++)
+			{
+				_Value d = a[L][r * K + k] - out[r][0];
+				loss[k] += d * d / nl;
+				da[L][r * K + k] = 2 * d / nl;
+			}
+		}
+		for (size_t i = L; i >= 1; i--)
+		{
+			size_t n = size[i], m = size[i - 1];
+			for (size_t j = 0; j < n * K; j++) ae[i][j] = da[i][j] * act.d(z[i][j]);
+			if (i > 1) std::fill(da[i - 1].begin(), da[i - 1].end(), _Value(0));
+			const _Value* w = weight[i].data();
+			const _Value* ap = a[i - 1].data();
+			_Value* g = dw[i].data();
+			_Value* dap = da[i - 1].data();
+			for (size_t r = 0; r < n; r++)
+			{
+				const _Value* aer = ae[i].data() + r * K;
+				for (size_t c = 0; c < m; c++)
+				{
+					size_t base = (r * m + c) * K;
+					const _Value* apc = ap + c * K;
+					for (size_t k = 0; k < K; k++) g[base + k] += aer[k] * apc[k];
+					if (i > 1)
+					{
+						_Value* dc = dap + c * K;
+						for (size_t k = 0; k < K; k++) dc[k] += w[base + k] * aer[k];
+					}
+				}
+			}
+			for (size_t j = 0; j < n * K; j++) db[i][j] += da[i][j];
+		}
+	}
+	// 打包后在几组固定的随机数据上比较每个模型的输出、损失和 db（即 da）：
+	// 原模型的激活函数必须与 act 相同、损失函数必须是 MSE，否则打包后的结果会不同
+	void check_packed(const std::vector<MLP<_Value>>& models)
+	{
+		size_t L = size.size() - 1;
+		std::mt19937_64 mt(size[0] * 1000003 + size[L]);
+		std::normal_distribution<double> u(0, 2);
+		const _Value tol = std::sqrt(std::numeric_limits<_Value>::epsilon());
+		auto close = [tol](const _Value& x, const _Value& y) { return std::abs(x - y) <= tol * (1 + std::abs(y)); };
+		std::vector<MLP<_Value>> ref(models.begin(), models.end());
+		for (int t = 0; t < 8; t++)
+		{
+			mxtype in(size[0], 1), out(size[L], 1);
+			for (size_t r = 0; r < size[0]; r++) in[r][0] = _Value(u(mt));
+			for (size_t r = 0; r < size[L]; r++) out[r][0] = _Value(u(mt));
+			std::valarray<_Value> loss(_Value(0), K);
+			forward(in);
+			backward(out, loss);
+			for (size_t k = 0; k < K; k++)
+			{
+				auto [l, rdw, rdb, rda] = ref[k].train(in, out);
+				auto a_ref = ref[k].get(in);
+				bool ok = close(loss[k], l);
+				for (size_t i = 1; i <= L && ok; i++)
+				{
+					for (size_t r = 0; r < size[i] && ok; r++) ok = close(a[i][r * K + k], a_ref[i][r][0]) && close(db[i][r * K + k], rdb[i][r][0]);
+				}
+				if (!ok) throw std::invalid_argument("Error in MLP_ensemble::MLP_ensemble: Model " + std::to_string(k) + " does not match the packed model. Its activation function should be acf and its loss function should be MSE.");
+			}
+			for (size_t i = 1; i <= L; i++)
+			{
+				std::fill(dw[i].begin(), dw[i].end(), _Value(0));
+				std::fill(db[i].begin(), db[i].end(), _Value(0));
+			}
+		}
+	}
+	// 按各自的学习率应用 dw / cnt 和 db / cnt，并清空 dw、db
+	void apply(size_t cnt)
+	{
+		std::valarray<_Value> step = beta / _Value(cnt);
+		for (size_t i = 1; i < size.size(); i++)
+		{
+			for (size_t j = 0; j < weight[i].size(); j += K)
+			{
+				for (size_t k = 0; k < K; k++) weight[i][j + k] -= step[k] * dw[i][j + k];
+			}
+			for (size_t j = 0; j < bias[i].size(); j += K)
+			{
+				for (size_t k = 0; k < K; k++) bias[i][j + k] -= step[k] * db[i][j + k];
+			}
+			std::fill(dw[i].begin(), dw[i].end(), _Value(0));
+			std::fill(db[i].begin(), db[i].end(), _Value(0));
+		}
+	}
+public:
+	/// <summary>
+	/// 新建 K = lr.size() 个模型，权重用 Xavier 高斯分布初始化，偏置为 0
+	/// </summary>
+	/// <param name="sz">层大小</param>
+	/// <param name="lr">每个模型的学习率</param>
+	/// <param name="seeds">每个模型的随机种子，为空则随机</param>
+	MLP_ensemble(const std::valarray<size_t>& sz, const std::valarray<_Value>& lr, const std::vector<unsigned long long>& seeds = {}, const _Act& acf = _Act())
+		: K(lr.size()), size(sz), beta(lr), act(acf)
+	{
+		if (sz.size() < 2) throw std::length_error("Error in MLP_ensemble::MLP_ensemble: The MLP should contain at least two layers(the input layer and the output layer), but the length of the size vector is " + std::to_string(sz.size()) + ".");
+		if (K == 0) throw std::invalid_argument("Error in MLP_ensemble::MLP_ensemble: The ensemble should contain at least one model.");
+		if (!seeds.empty() && seeds.size() != K) throw std::length_error("Error in MLP_ensemble::MLP_ensemble: The length of seeds should equals to the number of models.");
+		alloc();
+		std::random_device rd;
+		for (size_t k = 0; k < K; k++)
+		{
+			std::mt19937_64 mt(seeds.empty() ? rd() : seeds[k]);
+			for (size_t i = 1; i < size.size(); i++)
+			{
+				std::normal_distribution<_Value> u(0, std::sqrt(_Value(2) / (size[i - 1] + size[i])));
+				for (size_t j = k; j < weight[i].size(); j += K) weight[i][j] = u(mt);
+			}
+		}
+	}
+	/// <summary>
+	/// 把已有的若干个 MLP 打包（层大小必须相同）
+	/// 打包后只保留参数，所以必须给出与这些模型相同的激活函数，且它们的损失函数必须是 MSE；打包后会实测比较，不一致时抛出异常
+	/// </summary>
+	MLP_ensemble(const std::vector<MLP<_Value>>& models, const std::valarray<_Value>& lr, const _Act& acf)
+		: K(models.size()), beta(lr), act(acf)
+	{
+		if (K == 0) throw std::invalid_argument("Error in MLP_ensemble::MLP_ensemble: The ensemble should contain at least one model.");
+		if (lr.size() != K) throw std::length_error("Error in MLP_ensemble::MLP_ensemble: The length of lr should equals to the number of models.");
+		size = models[0].get_size();
+		alloc();
+		for (size_t k = 0; k < K; k++)
+		{
+			const auto& sz = models[k].get_size();
+			if (sz.size() != size.size() || (sz != size).max()) throw std::invalid_argument("Error in MLP_ensemble::MLP_ensemble: All the models should have the same size.");
+			vmxtype w = models[k].export_weight();
+			const auto& b = models[k].get_bias();
+			for (size_t i = 1; i < size.size(); i++)
+			{
+				for (size_t r = 0; r < size[i]; r++)
+				{
+					for (size_t c = 0; c < size[i - 1]; c++) weight[i][(r * size[i - 1] + c) * K + k] = w[i][r][c];
+					bias[i][r * K + k] = b[i][r][0];
+				}
+			}
+		}
+		check_packed(models);
+	}
+
+	// 模型个数
+	size_t count() const { return K; }
+	// 前向传播，返回每个模型的输出层
+	vmxtype get(const mxtype& in)
+	{
+		check_input(in, "get");
+		forward(in);
+		size_t L = size.size() - 1;
+		vmxtype res(K, mxtype(size[L], 1));
+		for (size_t k = 0; k < K; k++)
+		{
+			for (size_t r = 0; r < size[L]; r++) res[k][r][0] = a[L][r * K + k];
+		}
+		return res;
+	}
+	/// <summary>
+	/// 用一批数据训练所有模型：梯度取平均后按各自的学习率应用（与 main.cpp 中的用法相同）
+	/// </summary>
+	/// <returns>每个模型在这批数据上的平均损失</returns>
+	std::valarray<_Value> train_batch(const vmxtype& in, const vmxtype& out)
+	{
+		if (in.size() != out.size() || in.empty()) throw std::invalid_argument("Error in MLP_ensemble::train_batch: in and out should have the same nonzero length.");
+		std::valarray<_Value> loss(_Value(0), K);
+		for (size_t s = 0; s < in.size(); s++)
+		{
+			check_input(in[s], "train_batch");
+			forward(in[s]);
+			backward(out[s], loss);
+		}
+		apply(in.size());
+		last_loss = loss / _Value(in.size());
+		return last_loss;
+	}
+	// 单个样本训练并立即应用，返回每个模型的损失
+	std::valarray<_Value> train_and_apply(const mxtype& in, const mxtype& out) { return train_batch({ in }, { out }); }
+	// 每个模型最近一次训练的损失
+	const std::valarray<_Value>& loss() const { return last_loss; }
+	// 按最近一次训练的损失从小到大排列的模型编号
+	std::vector<size_t> rank() const
+	{
+		std::vector<size_t> res(K);
+		std::iota(res.begin(), res.end(), 0);
+		std::stable_sort(res.begin(), res.end(), [this](size_t x, size_t y) { return last_loss[x] < last_loss[y]; });
+		return res;
+	}
+	// 取出第 k 个模型，作为普通的 MLP（激活函数与打包时相同）
+	MLP<_Value> extract(size_t k) const
+	{
+		if (k >= K) throw std::out_of_range("Error in MLP_ensemble::extract: k should less than the number of models.");
+		_Act f = act;
+		MLP<_Value> res(size,
+			[f](const mxtype& in) { return forall(in, [f](const _Value& x) { return f(x); }); },
+			[f](const mxtype& in) { return forall(in, [f](const _Value& x) { return f.d(x); }); });
+		vmxtype w = res.get_weight(), b = res.get_bias();
+		for (size_t i = 1; i < size.size(); i++)
+		{
+			for (size_t r = 0; r < size[i]; r++)
+			{
+				for (size_t c = 0; c < size[i - 1]; c++) w[i][r][c] = weight[i][(r * size[i - 1] + c) * K + k];
+				b[i][r][0] = bias[i][r * K + k];
+			}
+		}
+		res.set_param(w, b);
+		return res;
+	}
+};
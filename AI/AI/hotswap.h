@@ -0,0 +1,140 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include "MLP.h"
+
+// 边训练边服务的 MLP：训练线程不断 apply_train，其它线程同时用 get 推理
+// 推理用的是参数的只读版本（快照），训练线程每 N 步发布一个新版本，用一次原子交换替换当前版本。
+// 读者不加锁：在自己的槽位里登记当前纪元（epoch），再读当前版本的指针；
+// 旧版本退休时记下纪元，等所有登记过不晚于该纪元的读者都离开后才释放（基于纪元的回收，类似 RCU）。
+// 训练相关的函数（train、apply_train、train_and_apply、publish、model）只能在一个训练线程中调用；get 和 pin 可以在任意线程中调用。
+template<typename _Model = MLP<long double>>
+class hotswap_MLP
+{
+private:
+	struct version_node
+	{
+		_Model model;
+		unsigned long long ver;
+	};
+	static constexpr uint64_t idle = UINT64_MAX;
+	static constexpr size_t max_readers = 256; // 同时持有版本的读者（guard）数上限，超过时 pin 会等待
+	// 每个槽位独占一条缓存行，读者之间不会互相干扰
+	struct alignas(64) reader_slot
+	{
+		std::atomic<bool> used{ false };
+		std::atomic<uint64_t> epoch{ idle };
+	};
+
+	_Model trainer; // 训练中的模型，只有训练线程访问
+	std::atomic<version_node*> current;
+	std::atomic<uint64_t> epoch{ 0 };
+	mutable reader_slot slots[max_readers];
+	std::vector<std::pair<version_node*, uint64_t>> retired; // 已被替换、等待释放的版本及其退休纪元
+	size_t every, steps = 0;
+	unsigned long long next_ver = 1; // 下一个发布的版本号
+
+	// 释放所有读者都已离开的旧版本
+	void reclaim()
+	{
+		uint64_t oldest = idle;
+		for (const auto& s : slots) oldest = std::min(oldest, s.epoch.load());
+		auto it = std::remove_if(retired.begin(), retired.end(), [oldest](const auto& r) {
+			if (r.second >= oldest) return false;
+			delete r.first;
+			return true;
+		});
+		retired.erase(it, retired.end());
+	}
+public:
+	// 持有一个版本，析构时归还；持有期间该版本不会被释放，也不会被修改
+	class guard
+	{
+	private:
+		reader_slot* slot;
+		const version_node* node;
+	public:
+		guard(reader_slot* s, const version_node* n) : slot(s), node(n) {}
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+		guard(guard&& g) noexcept : slot(g.slot), node(g.node) { g.slot = nullptr; }
+		~guard()
+		{
+			if (slot == nullptr) return;
+			slot->epoch.store(idle);
+			slot->used.store(false);
+		}
+		const _Model& operator*() const { return node->model; }
+		const _Model* operator->() const { return &node->model; }
+		// 版本号，每次发布加一
+		unsigned long long version() const { return node->ver; }
+	};
+
+	/// <summary>
+	/// 以 mlp 为初始参数，立即发布第一个版本
+	/// </summary>
+	/// <param name="mlp">初始模型</param>
+	/// <param name="publish_every">每多少次 apply_train 发布一次新版本</param>
+	explicit hotswap_MLP(const _Model& mlp, size_t publish_every = 1) : trainer(mlp), current(new version_node{ mlp, 0 }), every(std::max<size_t>(publish_every, 1)) {}
+	hotswap_MLP(const hotswap_MLP&) = delete;
+	hotswap_MLP& operator=(const hotswap_MLP&) = delete;
+	// 析构时不能还有读者
+	~hotswap_MLP()
+	{
+		delete current.load();
+		for (auto& r : retired) delete r.first;
+	}
+
+	// 取得当前版本，不加锁
+	guard pin() const
+	{
+		size_t id = std::hash<std::thread::id>()(std::this_thread::get_id()) % max_readers;
+		while (true)
+		{
+			for (size_t k = 0; k < max_readers; k++, id = (id + 1) % max_readers)
+			{
+				bool expect = false;
+				if (slots[id].used.load(std::memory_order_relaxed) || !slots[id].used.compare_exchange_strong(expect, true)) continue;
+				slots[id].epoch.store(epoch.load());
+				return guard(&slots[id], current.load());
+			}
+			std::this_thread::yield();
+		}
+	}
+	// 用当前版本推理
+	auto get(const auto& in) const
+	{
+		auto g = pin();
+		return g->get(in);
+	}
+	// 当前发布的版本号
+	unsigned long long version() const { return pin().version(); }
+
+	// 训练中的模型（只能在训练线程中使用）
+	_Model& model() { return trainer; }
+	// 把训练中的模型发布为新版本
+	void publish()
+	{
+		version_node* old = current.exchange(new version_node{ trainer, next_ver++ });
+		retired.push_back({ old, epoch.fetch_add(1) });
+		reclaim();
+	}
+	auto train(const auto& in, const auto& out) { return trainer.train(in, out); }
+	// 应用训练结果，每 publish_every 次发布一次
+	void apply_train(const auto& beta, const auto& dw, const auto& db)
+	{
+		trainer.apply_train(beta, dw, db);
+		if (++steps % every == 0) publish();
+	}
+	auto train_and_apply(const auto& beta, const auto& in, const auto& out)
+	{
+		auto [loss, dw, db, da] = trainer.train(in, out);
+		apply_train(beta, dw, db);
+		return loss;
+	}
+};
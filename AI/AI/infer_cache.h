@@ -0,0 +1,209 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include "MLP.h"
+
+// 推理结果缓存
+// 以输入向量的哈希加上模型的参数版本（MLP::get_version）为键。版本在所有模型之间唯一，
+// 所以多个模型可以共用一个缓存；参数一变，旧结果自然不再命中，无需手动清空。
+// 分成若干个分片，每个分片一把锁，多个线程可以同时查询；每个分片容量固定，满了按 LRU 或 CLOCK 淘汰。
+enum class cache_policy { LRU, CLOCK };
+
+// 命中统计
+struct cache_stats
+{
+	size_t hits, misses, evictions;
+	double hit_rate() const { return hits + misses == 0 ? 0 : double(hits) / (hits + misses); }
+};
+
+template<typename _Value = long double>
+class inference_cache
+{
+private:
+	using mxtype = type_matrix<_Value>;
+	using vmxtype = std::vector<mxtype>;
+	static constexpr size_t npos = SIZE_MAX;
+	struct entry
+	{
+		uint64_t key;
+		unsigned long long ver;
+		mxtype in; // 保存输入本身，哈希冲突时不会返回错误的结果
+		vmxtype out;
+		bool ref; // CLOCK：最近是否被访问过
+		size_t prev, next; // LRU：双向链表
+	};
+	struct shard
+	{
+		std::mutex mtx;
+		std::vector<entry> slots;
+		std::unordered_map<uint64_t, size_t> index;
+		size_t head = npos, tail = npos; // LRU：head 为最近使用
+		size_t hand = 0; // CLOCK：指针
+	};
+	size_t capacity; // 每个分片的容量
+	cache_policy policy;
+	std::unique_ptr<shard[]> shards;
+	size_t shard_count;
+	std::atomic<size_t> hits{ 0 }, misses{ 0 }, evictions{ 0 };
+
+	static uint64_t hash(const mxtype& in, unsigned long long ver)
+	{
+		uint64_t h = 0x9e3779b97f4a7c15ull ^ ver;
+		auto [r, c] = in.size();
+		for (size_t i = 0; i < r; i++)
+		{
+			for (size_t j = 0; j < c; j++) h ^= std::hash<_Value>()(in[i][j]) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+		}
+		return h;
+	}
+	shard& shard_of(uint64_t key) const { return shards[(key >> 32) % shard_count]; }
+	// LRU 链表操作
+	static void unlink(shard& s, size_t i)
+	{
+		auto& e = s.slots[i];
+		if (e.prev != npos) s.slots[e.prev].next = e.next; else s.head = e.next;
+		if (e.next != npos) s.slots[e.next].prev = e.prev; else s.tail = e.prev;
+	}
+	static void push_front(shard& s, size_t i)
+	{
+		auto& e = s.slots[i];
+		e.prev = npos;
+		e.next = s.head;
+		if (s.head != npos) s.slots[s.head].prev = i;
+		s.head = i;
+		if (s.tail == npos) s.tail = i;
+	}
+	// 选一个要被替换的位置
+	size_t victim(shard& s)
+	{
+		if (s.slots.size() < capacity)
+		{
+			s.slots.push_back({});
+			return s.slots.size() - 1;
+		}
+		size_t i;
+		if (policy == cache_policy::LRU)
+		{
+			i = s.tail;
+			unlink(s, i);
+		}
+		else
+		{
+			while (s.slots[s.hand].ref)
+			{
+				s.slots[s.hand].ref = false;
+				s.hand = (s.hand + 1) % capacity;
+			}
+			i = s.hand;
+			s.hand = (s.hand + 1) % capacity;
+		}
+		s.index.erase(s.slots[i].key);
+		evictions++;
+		return i;
+	}
+public:
+	/// <summary>
+	/// 新建缓存
+	/// </summary>
+	/// <param name="cap">总容量（条数）</param>
+	/// <param name="pol">淘汰策略</param>
+	/// <param name="shard_cnt">分片数，越多并发冲突越少</param>
+	explicit inference_cache(size_t cap = 4096, cache_policy pol = cache_policy::CLOCK, size_t shard_cnt = 16)
+		: capacity(std::max<size_t>(1, cap / std::max<size_t>(shard_cnt, 1))), policy(pol), shards(new shard[std::max<size_t>(shard_cnt, 1)]), shard_count(std::max<size_t>(shard_cnt, 1)) {}
+	// 复制时只复制配置，不复制缓存的内容
+	inference_cache(const inference_cache& c) : inference_cache(c.capacity * c.shard_count, c.policy, c.shard_count) {}
+	inference_cache& operator=(const inference_cache& c)
+	{
+		capacity = c.capacity;
+		policy = c.policy;
+		shard_count = c.shard_count;
+		shards.reset(new shard[shard_count]);
+		return *this;
+	}
+
+	// 查询参数版本为 ver 的模型对 in 的推理结果：命中则直接返回，否则调用 compute() 计算后存入缓存
+	template<typename _Fun>
+	vmxtype get(unsigned long long ver, const mxtype& in, const _Fun& compute)
+	{
+		uint64_t key = hash(in, ver);
+		shard& s = shard_of(key);
+		{
+			std::lock_guard<std::mutex> lk(s.mtx);
+			auto it = s.index.find(key);
+			if (it != s.index.end())
+			{
+				auto& e = s.slots[it->second];
+				if (e.ver == ver && e.in == in)
+				{
+					hits++;
+					if (policy == cache_policy::LRU) { unlink(s, it->second); push_front(s, it->second); }
+					else e.ref = true;
+					return e.out;
+				}
+			}
+		}
+		// 计算时不持有锁，同一个输入可能被并发地算两次，但结果相同
+		misses++;
+		vmxtype out = compute();
+		std::lock_guard<std::mutex> lk(s.mtx);
+		auto it = s.index.find(key);
+		size_t i;
+		if (it != s.index.end())
+		{
+			i = it->second;
+			if (policy == cache_policy::LRU) unlink(s, i);
+		}
+		else
+		{
+			i = victim(s);
+			s.index[key] = i;
+		}
+		auto& e = s.slots[i];
+		e.key = key;
+		e.ver = ver;
+		e.in = in;
+		e.out = out;
+		e.ref = false;
+		if (policy == cache_policy::LRU) push_front(s, i);
+		return out;
+	}
+	// 查询 model.get(in)
+	template<typename _Model>
+	vmxtype get(const _Model& model, const mxtype& in) { return get(model.get_version(), in, [&] { return model.get(in); }); }
+	cache_stats stats() const { return { hits, misses, evictions }; }
+	// 清空缓存和统计
+	void clear()
+	{
+		for (size_t k = 0; k < shard_count; k++)
+		{
+			std::lock_guard<std::mutex> lk(shards[k].mtx);
+			shards[k].slots.clear();
+			shards[k].index.clear();
+			shards[k].head = shards[k].tail = npos;
+			shards[k].hand = 0;
+		}
+		hits = misses = evictions = 0;
+	}
+};
+
+// 带推理缓存的 MLP，get 先查缓存，apply_train 之后旧的结果自动失效
+template<typename _Value = long double>
+class cached_MLP : public MLP<_Value>
+{
+protected:
+	using typename MLP<_Value>::mxtype;
+	using typename MLP<_Value>::vmxtype;
+	mutable inference_cache<_Value> cache;
+public:
+	using MLP<_Value>::MLP;
+	cached_MLP(const MLP<_Value>& mlp, size_t capacity = 4096, cache_policy policy = cache_policy::CLOCK) : MLP<_Value>(mlp), cache(capacity, policy) {}
+
+	virtual vmxtype get(const mxtype& in) const override { return cache.get(this->get_version(), in, [&] { return MLP<_Value>::get(in); }); }
+	cache_stats stats() const { return cache.stats(); }
+	void clear_cache() { cache.clear(); }
+};
@@ -0,0 +1,255 @@
+#pragma once
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "MLP.h"
+
+// 低秩分解的多层感知器
+// 秩为 r 的层把 n x m 的权重换成 W = U * V（U 为 n x r，V 为 r x m），参数量从 n * m 降到 (n + m) * r，
+// 前向 z = U * (V * a) + b 与反向传播都只做两次细长的矩阵乘法。秩为 0 的层仍然是普通的稠密层。
+// 低秩层的 weight[i] 为空矩阵，需要稠密权重时用 dense_weight(i) 或 export_weight（检查点等导出权重的地方都用后者）。
+template<typename _Value = long double>
+class lowrank_MLP : public MLP<_Value>
+{
+protected:
+	using typename MLP<_Value>::mxtype;
+	using typename MLP<_Value>::vmxtype;
+	using typename MLP<_Value>::vsztype;
+	using MLP<_Value>::weight;
+	using MLP<_Value>::bias;
+	using MLP<_Value>::size;
+	using MLP<_Value>::lossf;
+	using MLP<_Value>::bump_version;
+	vsztype rank; // 每一层的秩，0 表示稠密层，rank[0] 无意义
+	vmxtype U, V;
+
+	bool is_lowrank(size_t i) const { return rank[i] != 0; }
+	// 低秩层 W = U * V，乘法和梯度都不展开成稠密矩阵
+	virtual mxtype layer_mul(size_t i, const mxtype& x) const override { return is_lowrank(i) ? U[i] * (V[i] * x) : weight[i] * x; }
+	virtual mxtype layer_tmul(size_t i, const mxtype& x) const override { return is_lowrank(i) ? rotate(V[i]) * (rotate(U[i]) * x) : rotate(weight[i]) * x; }
+	// 低秩层的 dw[i] 为 delta U，delta V 放在 dw[size.size() + i]，所以 dw 的长度是层数的两倍
+	virtual void layer_grad(size_t i, const mxtype& ae, const mxtype& a, vmxtype& dw) const override
+	{
+		if (!is_lowrank(i)) { dw[i] = ae * rotate(a); return; }
+		dw[i] = ae * rotate(V[i] * a); // delta U = ae * (V * a)^T
+		dw[size.size() + i] = (rotate(U[i]) * ae) * rotate(a); // delta V = (U^T * ae) * a^T
+	}
+	virtual void layer_apply(size_t i, const _Value& beta, const vmxtype& dw) override
+	{
+		if (!is_lowrank(i)) { weight[i] -= beta * dw[i]; return; }
+		U[i] -= beta * dw[i];
+		V[i] -= beta * dw[size.size() + i];
+	}
+	virtual size_t grad_count() const override { return size.size() * 2; }
+	// 对矩阵的各列做 Gram-Schmidt 正交化（改进版），列数不超过行数
+	static void orthonormalize(mxtype& q)
+	{
+		auto [n, r] = q.size();
+		for (size_t j = 0; j < r; j++)
+		{
+			for (size_t k = 0; k < j; k++)
+			{
+				_Value d = 0;
+				for (size_t i = 0; i < n; i++) d += q[i][j] * q[i][k];
+				for (size_t i = 0; i < n; i++) q[i][j] -= d * q[i][k];
+			}
+			_Value len = 0;
+			for (size_t i = 0; i < n; i++) len += q[i][j] * q[i][j];
+			len = std::sqrt(len);
+			if (len == 0) continue;
+			for (size_t i = 0; i < n; i++) q[i][j] /= len;
+		}
+	}
+public:
+	/// <summary>
+	/// 截断 SVD：求 W 的最佳秩 r 近似 W ≈ U * V（子空间迭代）
+	/// </summary>
+	/// <param name="w">n x m 的权重</param>
+	/// <param name="r">秩，超过 min(n, m) 时取 min(n, m)</param>
+	/// <param name="iters">迭代次数</param>
+	/// <returns>{ U (n x r), V (r x m) }</returns>
+	static std::pair<mxtype, mxtype> factorize(const mxtype& w, size_t r, unsigned iters = 30)
+	{
+		auto [n, m] = w.size();
+		r = std::min({ r, n, m });
+		if (r == 0) throw std::invalid_argument("Error in lowrank_MLP::factorize: The rank should be positive.");
+		std::mt19937_64 mt(n * 1000003 + m * 1009 + r);
+		std::normal_distribution<double> u(0, 1);
+		mxtype q(m, r);
+		for (auto& p : q) p = _Value(u(mt));
+		orthonormalize(q);
+		mxtype wt = rotate(w);
+		for (unsigned it = 0; it < iters; it++)
+		{
+			mxtype z = w * q;
+			orthonormalize(z);
+			q = wt * z;
+			orthonormalize(q);
+		}
+		// q 的各列张成 W 的前 r 个右奇异向量空间，W * q * q^T 即为最佳秩 r 近似
+		return { w * q, rotate(q) };
+	}
+
+	// 从 MLP 压缩：ranks[i] 非 0 的层用截断 SVD 分解
+	lowrank_MLP(const MLP<_Value>& mlp, const vsztype& ranks) : MLP<_Value>(mlp) { compress(ranks); }
+	// 直接训练：先按 MLP 的方式初始化，再分解成给定的秩
+	lowrank_MLP(const vsztype& sz, const vsztype& ranks) : lowrank_MLP(MLP<_Value>(sz), ranks) {}
+
+	// 复制同类对象时不展开低秩层
+	lowrank_MLP(const lowrank_MLP& o) : MLP<_Value>(o, typename MLP<_Value>::shallow_copy_t()), rank(o.rank), U(o.U), V(o.V) {}
+	lowrank_MLP& operator=(const lowrank_MLP& o)
+	{
+		if (this == &o) return *this;
+		this->copy_from(o, false);
+		rank = o.rank;
+		U = o.U;
+		V = o.V;
+		return *this;
+	}
+
+	// 把第 i 层的秩改为 ranks[i]（0 表示恢复成稠密层）
+	void compress(const vsztype& ranks)
+	{
+		if (ranks.size() != size.size()) throw std::length_error("Error in lowrank_MLP::compress: The length of ranks should equals to the number of layers.");
+		if (rank.size() == 0) rank = vsztype(size_t(0), size.size());
+		U.resize(size.size());
+		V.resize(size.size());
+		for (size_t i = 1; i < size.size(); i++)
+		{
+			mxtype w = dense_weight(i);
+			size_t r = std::min({ ranks[i], size[i], size[i - 1] });
+			rank[i] = r;
+			if (r == 0) { weight[i] = w; U[i] = V[i] = mxtype(); continue; }
+			std::tie(U[i], V[i]) = factorize(w, r);
+			weight[i] = mxtype();
+		}
+		bump_version();
+	}
+	// 第 i 层的稠密权重（低秩层为 U * V）
+	mxtype dense_weight(size_t i) const { return rank.size() != 0 && is_lowrank(i) ? U[i] * V[i] : weight[i]; }
+	const vsztype& get_rank() const { return rank; }
+	// 低秩层的 weight[i] 为空，导出时展开成 U * V
+	virtual void export_weight_to(vmxtype& w) const override
+	{
+		if (w.size() != weight.size()) w.resize(weight.size());
+		for (size_t i = 0; i < weight.size(); i++) w[i] = dense_weight(i);
+	}
+	// 参数个数（权重 + 偏置）
+	size_t param_count() const
+	{
+		size_t res = 0;
+		for (size_t i = 1; i < size.size(); i++)
+		{
+			res += size[i] + (is_lowrank(i) ? (size[i] + size[i - 1]) * rank[i] : size[i] * size[i - 1]);
+		}
+		return res;
+	}
+
+	// 低秩层保存 U 和 V，恢复时不需要重新分解
+	virtual void export_params(std::string& buf) const override
+	{
+		binary_io::put_string(buf, "lowrank_MLP");
+		for (size_t i = 1; i < size.size(); i++)
+		{
+			binary_io::put<uint64_t>(buf, rank[i]);
+			if (is_lowrank(i))
+			{
+				binary_io::put_matrix(buf, U[i]);
+				binary_io::put_matrix(buf, V[i]);
+			}
+			else binary_io::put_matrix(buf, weight[i]);
+		}
+		binary_io::put_matrices(buf, bias);
+	}
+	virtual void import_params(binary_io::reader& rd) override
+	{
+		const std::string err = "Error in lowrank_MLP::import_params: The data is not the parameters of a lowrank_MLP with the same size.";
+		if (!rd.expect("lowrank_MLP")) throw std::invalid_argument(err);
+		vsztype r(size_t(0), size.size());
+		vmxtype w(size.size()), u(size.size()), v(size.size()), b;
+		w[0] = weight[0];
+		for (size_t i = 1; i < size.size(); i++)
+		{
+			uint64_t k;
+			if (!rd.get(k) || k > std::min(size[i], size[i - 1])) throw std::invalid_argument(err);
+			r[i] = k;
+			if (k == 0)
+			{
+				if (!rd.get_matrix(w[i]) || w[i].size() != std::pair<size_t, size_t>(size[i], size[i - 1])) throw std::invalid_argument(err);
+			}
+			else if (!rd.get_matrix(u[i]) || !rd.get_matrix(v[i]) || u[i].size() != std::pair<size_t, size_t>(size[i], k) || v[i].size() != std::pair<size_t, size_t>(k, size[i - 1])) throw std::invalid_argument(err);
+		}
+		if (!rd.get_matrices(b) || b.size() != bias.size()) throw std::invalid_argument(err);
+		for (size_t i = 0; i < b.size(); i++) if (b[i].size() != bias[i].size()) throw std::invalid_argument(err);
+		rank = r;
+		weight = w;
+		U = u;
+		V = v;
+		bias = b;
+		bump_version();
+	}
+	// 设置稠密参数后按原来的秩重新分解
+	virtual void set_param(const vmxtype& w, const vmxtype& b) override
+	{
+		vsztype r = rank;
+		vmxtype old = weight;
+		rank = vsztype(size_t(0), size.size());
+		for (size_t i = 1; i < size.size(); i++) weight[i] = mxtype(size[i], size[i - 1]);
+		try { MLP<_Value>::set_param(w, b); }
+		catch (...) { rank = r; weight = old; throw; }
+		compress(r);
+	}
+	// 在一组数据上的平均损失
+	_Value eval_loss(const vmxtype& in, const vmxtype& out) const
+	{
+		if (in.size() != out.size() || in.empty()) throw std::invalid_argument("Error in lowrank_MLP::eval_loss: in and out should have the same nonzero length.");
+		_Value sum = 0;
+		for (size_t i = 0; i < in.size(); i++) sum += lossf(this->get(in[i]).back(), out[i]);
+		return sum / _Value(in.size());
+	}
+};
+
+// 某个秩下的精度和速度
+struct lowrank_stat
+{
+	size_t rank; // 秩
+	double loss, loss_increase; // 压缩后的平均损失，以及比不压缩时增加了多少
+	size_t params, dense_params; // 压缩后/压缩前的参数个数
+	double ns, dense_ns; // 压缩后/压缩前一次 get 的平均耗时（纳秒）
+	double speedup; // dense_ns / ns
+};
+/// <summary>
+/// 把 mlp 的第 layer 层分别压缩到 ranks 中的每个秩，报告精度损失和加速比
+/// </summary>
+/// <param name="mlp">训练好的网络</param>
+/// <param name="layer">要压缩的层（其它层保持稠密）</param>
+/// <param name="ranks">要比较的秩</param>
+/// <param name="in">验证集输入</param>
+/// <param name="out">验证集输出</param>
+/// <param name="repeat">测速时 get 的次数</param>
+template<typename _Value>
+std::vector<lowrank_stat> lowrank_report(const MLP<_Value>& mlp, size_t layer, const std::vector<size_t>& ranks, const std::vector<type_matrix<_Value>>& in, const std::vector<type_matrix<_Value>>& out, unsigned repeat = 100)
+{
+	const auto& sz = mlp.get_size();
+	if (layer == 0 || layer >= sz.size()) throw std::out_of_range("Error in lowrank_report: layer should be in [1, the number of layers).");
+	auto timeit = [&](lowrank_MLP<_Value>& net) {
+		auto st = std::chrono::steady_clock::now();
+		for (unsigned r = 0; r < repeat; r++) net.get(in[r % in.size()]);
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - st).count() / std::max(repeat, 1u);
+	};
+	lowrank_MLP<_Value> dense(mlp, std::valarray<size_t>(size_t(0), sz.size()));
+	double dense_loss = double(dense.eval_loss(in, out));
+	double dense_ns = timeit(dense);
+	std::vector<lowrank_stat> res;
+	for (size_t r : ranks)
+	{
+		std::valarray<size_t> rk(size_t(0), sz.size());
+		rk[layer] = r;
+		lowrank_MLP<_Value> net(mlp, rk);
+		double loss = double(net.eval_loss(in, out));
+		double ns = timeit(net);
+		res.push_back({ net.get_rank()[layer], loss, loss - dense_loss, net.param_count(), dense.param_count(), ns, dense_ns, dense_ns / ns });
+	}
+	return res;
+}
@@ -4,6 +4,47 @@
 #include <valarray>
 #include <utility>
 #include <vector>
+#include <unordered_map>
+#include "tools.h"
+#include "threadpool.h"
+
+// ˷˵ĲͬĽȫֻͬӰٶ
+struct gemm_params
+{
+	size_t tile = 64; // ֿ飬ÿ tile x tileҲǲ
+	size_t kblock = 256; // k ֿ飬 y ⼸ڻ
+	size_t unroll = 1; // ڲѭչ1, 2, 4, 8
+	size_t threshold = 1 << 15; // n * m * pֵʱ
+	bool packed = false; // Ȱ y һ鸴Ƶڴ㣬
+	friend bool operator==(const gemm_params&, const gemm_params&) = default;
+};
+// ˷״x Ϊ n x my Ϊ m x pelem ΪԪ͵ĴС
+struct gemm_shape
+{
+	size_t n, m, p, elem;
+	friend bool operator==(const gemm_shape&, const gemm_shape&) = default;
+};
+struct gemm_shape_hash
+{
+	size_t operator()(const gemm_shape& s) const { return ((s.n * 1000003 + s.m) * 1000003 + s.p) * 31 + s.elem; }
+};
+// ĲвСзֵʱм
+struct matrix_parallel_config
+{
+	gemm_params gemm; // ˷Ĭϲ
+	std::unordered_map<gemm_shape, gemm_params, gemm_shape_hash> tuned; // Ź״ autotune.hֻڵŻȡʱ޸ģҪͬʱ
+	size_t tuned_threads = 0; // tuned ڶٸ߳²ģ߳ͬʱʹ
+	size_t elementwise_threshold = 1 << 15; // ԪԪظֵʱ
+	size_t elementwise_grain = 1 << 12; // ԪʱÿٴԪظ
+	// ȡĳ״ʹõĳ˷
+	const gemm_params& gemm_for(const gemm_shape& s) const
+	{
+		if (tuned.empty() || tuned_threads != thread_pool::global().size()) return gemm;
+		auto it = tuned.find(s);
+		return it == tuned.end() ? gemm : it->second;
+	}
+};
+inline matrix_parallel_config& matrix_config() { static matrix_parallel_config cfg; return cfg; }
 
 // 
 template<typename _Valt>
@@ -128,6 +169,19 @@ public:
 	}
 };
 
+// й
+namespace
+{
+	//  n x m ÿһ i  f(i)Ԫؽ϶ʱзֶβ
+	template<typename _Fun>
+	void parallel_rows(size_t n, size_t m, const _Fun& f)
+	{
+		const auto& cfg = matrix_config();
+		auto run = [&](size_t l, size_t r) { for (size_t i = l; i < r; i++) f(i); };
+		if (n * m < cfg.elementwise_threshold || n <= 1) run(0, n);
+		else thread_pool::global().parallel_for(0, n, std::max<size_t>(1, cfg.elementwise_grain / std::max<size_t>(m, 1)), run);
+	}
+}
 // Ƚ
 namespace
 {
@@ -155,30 +209,39 @@ namespace
 	{
 		if (x.size() != y.size()) throw std::invalid_argument("Error in operator+(const type_matrix &, const type_matrix &): The size(rows and columns) of the matrix x and y should be the same.");
 		type_matrix<Q> res = x;
-		for (size_t i = 0; i < x.size().first; i++)
-		{
+		parallel_rows(x.size().first, x.size().second, [&](size_t i) {
 			for (size_t j = 0; j < y.size().second; j++)
 			{
 				res[i][j] += y[i][j];
 			}
-		}
+		});
 		return res;
 	}
 	template<typename Q>
 	type_matrix<Q> operator-(const type_matrix<Q>& x)
 	{
 		type_matrix res = x;
-		for (size_t i = 0; i < res.size().first; i++)
-		{
+		parallel_rows(res.size().first, res.size().second, [&](size_t i) {
 			for (size_t j = 0; j < res.size().second; j++)
 			{
 				res[i][j] = -res[i][j];
 			}
-		}
+		});
 		return res;
 	}
 	template<typename Q>
 	type_matrix<Q> operator-(const type_matrix<Q>& x, const type_matrix<Q>& y) { return x + (-y); }
+	// rr[j] += k * yr[j]0 <= j < wѭչ _U 
+	template<size_t _U, typename Q>
+	void gemm_row(Q* rr, const Q* yr, const Q& k, size_t w)
+	{
+		size_t j = 0;
+		for (; j + _U <= w; j += _U)
+		{
+			for (size_t u = 0; u < _U; u++) rr[j + u] += k * yr[j + u];
+		}
+		for (; j < w; j++) rr[j] += k * yr[j];
+	}
 	template<typename Q>
 	type_matrix<Q> operator*(const type_matrix<Q>& x, const type_matrix<Q>& y)
 	{
@@ -189,15 +252,51 @@ namespace
 		}
 		size_t n = x.size().first, m = x.size().second, p = y.size().second;
 		type_matrix<Q> res(n, p);
-		for (unsigned i = 0; i < n; i++)
-		{
-			for (unsigned j = 0; j < p; j++)
+		if (n == 0 || m == 0 || p == 0) return res;
+		const gemm_params& cfg = matrix_config().gemm_for({ n, m, p, sizeof(Q) });
+		size_t kb = std::max<size_t>(cfg.kblock, 1);
+		//  [i0, i1) x [j0, j1) һ飬ÿԪ԰ k Сۼӣ봮ȫͬ
+		auto tile = [&](size_t i0, size_t i1, size_t j0, size_t j1) {
+			size_t w = j1 - j0;
+			std::vector<Q> buf(cfg.packed ? std::min(kb, m) * w : 0);
+			for (size_t k0 = 0; k0 < m; k0 += kb)
 			{
-				for (unsigned k = 0; k < m; k++)
+				size_t k1 = std::min(m, k0 + kb);
+				if (cfg.packed)
+				{
+					for (size_t k = k0; k < k1; k++) std::copy_n(&y[k][j0], w, buf.data() + (k - k0) * w);
+				}
+				for (size_t i = i0; i < i1; i++)
 				{
-					res[i][j] += x[i][k] * y[k][j]; // ۺ Floyd 
+					Q* rr = &res[i][j0];
+					for (size_t k = k0; k < k1; k++)
+					{
+						const Q* yr = cfg.packed ? buf.data() + (k - k0) * w : &y[k][j0];
+						Q xik = x[i][k];
+						// ۺ Floyd 
+						switch (cfg.unroll)
+						{
+						case 8: gemm_row<8>(rr, yr, xik, w); break;
+						case 4: gemm_row<4>(rr, yr, xik, w); break;
+						case 2: gemm_row<2>(rr, yr, xik, w); break;
+						default: gemm_row<1>(rr, yr, xik, w); break;
+						}
+					}
 				}
 			}
+		};
+		if (n * m * p < cfg.threshold) tile(0, n, 0, p);
+		else
+		{
+			size_t t = std::max<size_t>(cfg.tile, 1);
+			size_t tn = (n + t - 1) / t, tp = (p + t - 1) / t;
+			thread_pool::global().parallel_for(0, tn * tp, 1, [&](size_t l, size_t r) {
+				for (size_t id = l; id < r; id++)
+				{
+					size_t bi = id / tp, bj = id % tp;
+					tile(bi * t, std::min(n, bi * t + t), bj * t, std::min(p, bj * t + t));
+				}
+			});
 		}
 		return res;
 	}
@@ -205,7 +304,7 @@ namespace
 	type_matrix<Q> operator*(const type_matrix<Q>& x, const Q& y)
 	{
 		auto res = x;
-		for (auto& z : res) z *= y;
+		parallel_rows(res.size().first, res.size().second, [&](size_t i) { for (size_t j = 0; j < res.size().second; j++) res[i][j] *= y; });
 		return res;
 	}
 	template<typename Q>
@@ -214,7 +313,7 @@ namespace
 	type_matrix<Q> operator/(const type_matrix<Q> &x, const Q &y)
 	{
 		auto res = x;
-		for (auto& z : res) z /= y;
+		parallel_rows(res.size().first, res.size().second, [&](size_t i) { for (size_t j = 0; j < res.size().second; j++) res[i][j] /= y; });
 		return res;
 	}
 }
@@ -241,7 +340,7 @@ namespace
 	type_matrix<_Valt> getrow(const type_matrix<_Valt>& p, size_t row) { size_t m = p.size().second; type_matrix<_Valt> res(1, m); for (size_t i = 0; i < m; i++) { res[0][i] = p[row][i]; } return res; }
 	// ת
 	template<typename _Valt>
-	type_matrix<_Valt> rotate(const type_matrix<_Valt>& p) { auto [n, m] = p.size(); type_matrix<_Valt> res(m, n); for (size_t i = 0; i < n; i++) { for (size_t j = 0; j < m; j++) { res[j][i] = p[i][j]; } } return res; }
+	type_matrix<_Valt> rotate(const type_matrix<_Valt>& p) { auto [n, m] = p.size(); type_matrix<_Valt> res(m, n); parallel_rows(m, n, [&](size_t j) { for (size_t i = 0; i < n; i++) { res[j][i] = p[i][j]; } }); return res; }
 	//  Dot Product
 	template<typename _Valt>
 	type_matrix<_Valt> dot_p(const type_matrix<_Valt>& x, const type_matrix<_Valt>& y)
@@ -250,13 +349,21 @@ namespace
 		auto n = r.first, m = r.second;
 		if (r != y.size()) throw std::invalid_argument("Error in Dot_P: The size of matrix x and y should be the same.");
 		type_matrix<_Valt> res(n, m);
-		for (size_t i = 0; i < n; i++)
-		{
+		parallel_rows(n, m, [&](size_t i) {
 			for (size_t j = 0; j < m; j++)
 			{
 				res[i][j] = x[i][j] * y[i][j];
 			}
-		}
+		});
+		return res;
+	}
+	// type_matrix 汾 forall tools.hԪ㰴вУ
+	template<typename _Valt, typename _Fun>
+	type_matrix<_Valt> forall(const type_matrix<_Valt>& x, const _Fun& f)
+	{
+		auto [n, m] = x.size();
+		type_matrix<_Valt> res(n, m);
+		parallel_rows(n, m, [&](size_t i) { for (size_t j = 0; j < m; j++) res[i][j] = ::forall(x[i][j], f); });
 		return res;
 	}
 	// ͬһ㣨Ҵ£Ҫɣ
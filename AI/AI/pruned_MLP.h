@@ -0,0 +1,326 @@
+#pragma once
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include "MLP.h"
+#include "sparse_matrix.h"
+
+// 剪枝后的多层感知器
+// 按权重绝对值剪枝（全局阈值或逐层比例），被剪掉的权重由 mask 记录，之后的 apply_train 不会让它们复活，可以直接继续训练（微调）。
+// 密度低于 sparse_cutover 的层只以稀疏矩阵（CSR）保存，不再保留稠密的 weight 和 mask（稀疏结构本身就是 mask），
+// get、train 和 apply_train 都直接在 CSR 上计算，微调时只更新保留下来的权重的值。
+template<typename _Value = long double>
+class pruned_MLP : public MLP<_Value>
+{
+protected:
+	using typename MLP<_Value>::mxtype;
+	using typename MLP<_Value>::vmxtype;
+	using MLP<_Value>::weight;
+	using MLP<_Value>::bias;
+	using MLP<_Value>::size;
+	using MLP<_Value>::bump_version;
+	vmxtype mask; // 1 为保留，0 为剪掉；为空表示还没有剪枝。稀疏存储的层的 mask[i] 为空
+	std::vector<sparse_matrix<_Value>> sparse; // 稀疏存储的层的权重，这些层的 weight[i] 为空
+	std::vector<bool> on_sparse; // 每一层是否为稀疏存储
+	std::valarray<double> dens; // 每一层保留下来的权重所占比例
+	double sparse_cutover = 0.5; // 密度低于这个值时使用稀疏存储
+
+	// 根据 mask 清零权重，密度低于 sparse_cutover 的层转成稀疏存储。调用前所有层都必须是稠密存储（见 densify）
+	void apply_mask()
+	{
+		sparse.assign(size.size(), sparse_matrix<_Value>());
+		on_sparse.assign(size.size(), false);
+		dens.resize(size.size(), 1.0);
+		for (unsigned i = 1; i < size.size(); i++)
+		{
+			weight[i] = dot_p(weight[i], mask[i]);
+			dens[i] = mask_density(mask[i]);
+			if (dens[i] >= sparse_cutover) continue;
+			sparse[i] = sparse_matrix<_Value>(weight[i], mask[i]);
+			on_sparse[i] = true;
+			weight[i] = mxtype();
+			mask[i] = mxtype();
+		}
+		bump_version();
+	}
+	static double mask_density(const mxtype& mk)
+	{
+		auto [n, m] = mk.size();
+		size_t kept = 0;
+		for (size_t j = 0; j < n; j++)
+		{
+			for (size_t k = 0; k < m; k++) kept += mk[j][k] != 0;
+		}
+		return n * m == 0 ? 0 : double(kept) / (n * m);
+	}
+	// 稀疏存储的层直接用 CSR 计算
+	virtual mxtype layer_mul(size_t i, const mxtype& x) const override { return use_sparse(i) ? sparse[i] * x : weight[i] * x; }
+	virtual mxtype layer_tmul(size_t i, const mxtype& x) const override { return use_sparse(i) ? sparse[i].transpose_mul(x) : rotate(weight[i]) * x; }
+	// 微调：稀疏存储的层只更新保留下来的权重；稠密存储的层更新后乘上 mask，被剪掉的权重保持为 0
+	virtual void layer_apply(size_t i, const _Value& beta, const vmxtype& dw) override
+	{
+		if (use_sparse(i)) { sparse[i].add_scaled(-beta, dw[i]); return; }
+		weight[i] -= beta * dw[i];
+		if (!mask.empty()) weight[i] = dot_p(weight[i], mask[i]);
+	}
+	// 把稀疏存储的层恢复成稠密的 weight 和 mask，以便重新剪枝或替换参数
+	void densify()
+	{
+		for (unsigned i = 1; i < on_sparse.size(); i++)
+		{
+			if (!on_sparse[i]) continue;
+			weight[i] = mxtype(sparse[i]);
+			mask[i] = sparse[i].pattern();
+			sparse[i] = sparse_matrix<_Value>();
+			on_sparse[i] = false;
+		}
+	}
+	void init_mask()
+	{
+		if (!mask.empty()) return;
+		mask.resize(size.size());
+		for (unsigned i = 1; i < size.size(); i++)
+		{
+			mask[i].resize(weight[i].size());
+			for (auto& p : mask[i]) p = 1;
+		}
+	}
+	// 第 i 层所有权重的绝对值，被剪掉的记为 0
+	std::vector<_Value> abs_weights(size_t i) const
+	{
+		std::vector<_Value> res;
+		if (use_sparse(i))
+		{
+			res.assign(size[i] * size[i - 1] - sparse[i].nnz(), _Value(0));
+			for (const auto& p : sparse[i].values()) res.push_back(std::abs(p));
+			return res;
+		}
+		auto [n, m] = weight[i].size();
+		for (size_t j = 0; j < n; j++)
+		{
+			for (size_t k = 0; k < m; k++) res.push_back(std::abs(weight[i][j][k]));
+		}
+		return res;
+	}
+public:
+	using MLP<_Value>::MLP;
+	// 从训练好的 MLP 构造
+	pruned_MLP(const MLP<_Value>& mlp) : MLP<_Value>(mlp) {}
+	// 复制同类对象时不展开稀疏存储的层
+	pruned_MLP(const pruned_MLP& o) : MLP<_Value>(o, typename MLP<_Value>::shallow_copy_t()), mask(o.mask), sparse(o.sparse), on_sparse(o.on_sparse), dens(o.dens), sparse_cutover(o.sparse_cutover) {}
+	pruned_MLP& operator=(const pruned_MLP& o)
+	{
+		if (this == &o) return *this;
+		this->copy_from(o, false);
+		mask = o.mask;
+		sparse = o.sparse;
+		on_sparse = o.on_sparse;
+		dens = o.dens;
+		sparse_cutover = o.sparse_cutover;
+		return *this;
+	}
+
+	// 剪掉第 layer 层（layer = 0 表示所有层）绝对值小于 t 的权重
+	void prune_threshold(const _Value& t, size_t layer = 0)
+	{
+		if (layer >= size.size()) throw std::out_of_range("Error in pruned_MLP::prune_threshold: layer should less than the number of layers.");
+		densify();
+		init_mask();
+		for (unsigned i = 1; i < size.size(); i++)
+		{
+			if (layer != 0 && i != layer) continue;
+			auto [n, m] = weight[i].size();
+			for (size_t j = 0; j < n; j++)
+			{
+				for (size_t k = 0; k < m; k++)
+				{
+					if (std::abs(weight[i][j][k]) < t) mask[i][j][k] = 0;
+				}
+			}
+		}
+		apply_mask();
+	}
+	// 全局剪枝：所有层一起排序，剪掉绝对值最小的 sparsity（0 ~ 1）比例的权重
+	void prune_global(double sparsity)
+	{
+		if (sparsity < 0 || sparsity > 1) throw std::invalid_argument("Error in pruned_MLP::prune_global: The sparsity should be in [0, 1].");
+		std::vector<_Value> all;
+		for (unsigned i = 1; i < size.size(); i++)
+		{
+			auto w = abs_weights(i);
+			all.insert(all.end(), w.begin(), w.end());
+		}
+		size_t k = size_t(sparsity * all.size());
+		if (k == 0) return;
+		if (k >= all.size()) { prune_threshold(std::numeric_limits<_Value>::infinity()); return; }
+		std::nth_element(all.begin(), all.begin() + k, all.end());
+		prune_threshold(all[k]);
+	}
+	// 逐层剪枝：第 i 层剪掉绝对值最小的 sparsity[i]（0 ~ 1）比例的权重，sparsity[0] 无意义
+	void prune_layers(const std::valarray<double>& sparsity)
+	{
+		if (sparsity.size() != size.size()) throw std::length_error("Error in pruned_MLP::prune_layers: The length of sparsity should equals to the number of layers.");
+		for (unsigned i = 1; i < size.size(); i++)
+		{
+			if (sparsity[i] < 0 || sparsity[i] > 1) throw std::invalid_argument("Error in pruned_MLP::prune_layers: The sparsity should be in [0, 1].");
+			std::vector<_Value> all = abs_weights(i);
+			size_t k = size_t(sparsity[i] * all.size());
+			if (k == 0) continue;
+			if (k >= all.size()) { prune_threshold(std::numeric_limits<_Value>::infinity(), i); continue; }
+			std::nth_element(all.begin(), all.begin() + k, all.end());
+			prune_threshold(all[k], i);
+		}
+	}
+	// 每一层权重的密度（下标 0 无意义）
+	std::valarray<double> density() const
+	{
+		std::valarray<double> res(1.0, size.size());
+		if (!mask.empty()) res = dens;
+		res[0] = 0;
+		return res;
+	}
+	// 参数占用的内存（字节），{ 剪枝前的稠密权重, 当前实际占用 }
+	// 当前占用是稀疏存储的层的 CSR，加上稠密存储的层的 weight 和 mask
+	std::pair<size_t, size_t> memory_bytes() const
+	{
+		size_t dense = 0, cur = 0;
+		for (unsigned i = 1; i < size.size(); i++)
+		{
+			size_t d = size[i] * size[i - 1] * sizeof(_Value);
+			dense += d;
+			cur += use_sparse(i) ? sparse[i].memory_bytes() : (mask.empty() ? d : d * 2);
+		}
+		return { dense, cur };
+	}
+	bool use_sparse(size_t i) const { return i < on_sparse.size() && on_sparse[i]; }
+	// 修改后按新的阈值重新决定每一层的存储方式
+	void set_sparse_cutover(double d)
+	{
+		densify();
+		sparse_cutover = d;
+		if (!mask.empty()) apply_mask();
+	}
+	// 稀疏存储的层保存 CSR，稠密存储的层保存 weight 和 mask，恢复后剪枝结构和存储方式都与保存时相同
+	virtual void export_params(std::string& buf) const override
+	{
+		binary_io::put_string(buf, "pruned_MLP");
+		binary_io::put<double>(buf, sparse_cutover);
+		binary_io::put<uint8_t>(buf, !mask.empty());
+		for (size_t i = 1; i < size.size(); i++)
+		{
+			binary_io::put<uint8_t>(buf, use_sparse(i));
+			if (use_sparse(i)) sparse[i].save(buf);
+			else
+			{
+				binary_io::put_matrix(buf, weight[i]);
+				if (!mask.empty()) binary_io::put_matrix(buf, mask[i]);
+			}
+		}
+		binary_io::put_matrices(buf, bias);
+	}
+	virtual void import_params(binary_io::reader& rd) override
+	{
+		const std::string err = "Error in pruned_MLP::import_params: The data is not the parameters of a pruned_MLP with the same size.";
+		double cut;
+		uint8_t pruned;
+		if (!rd.expect("pruned_MLP") || !rd.get(cut) || !rd.get(pruned)) throw std::invalid_argument(err);
+		vmxtype w(size.size()), mk(pruned ? size.size() : 0), b;
+		std::vector<sparse_matrix<_Value>> sp(size.size());
+		std::vector<bool> on(size.size(), false);
+		std::valarray<double> ds(1.0, size.size());
+		w[0] = weight[0];
+		for (size_t i = 1; i < size.size(); i++)
+		{
+			std::pair<size_t, size_t> shape(size[i], size[i - 1]);
+			uint8_t s;
+			if (!rd.get(s)) throw std::invalid_argument(err);
+			if (s)
+			{
+				if (!pruned || !sp[i].load(rd) || sp[i].size() != shape) throw std::invalid_argument(err);
+				on[i] = true;
+				ds[i] = sp[i].density();
+				continue;
+			}
+			if (!rd.get_matrix(w[i]) || w[i].size() != shape) throw std::invalid_argument(err);
+			if (!pruned) continue;
+			if (!rd.get_matrix(mk[i]) || mk[i].size() != shape) throw std::invalid_argument(err);
+			ds[i] = mask_density(mk[i]);
+		}
+		if (!rd.get_matrices(b) || b.size() != bias.size()) throw std::invalid_argument(err);
+		for (size_t i = 0; i < b.size(); i++) if (b[i].size() != bias[i].size()) throw std::invalid_argument(err);
+		sparse_cutover = cut;
+		weight = w;
+		bias = b;
+		mask = mk;
+		if (pruned)
+		{
+			sparse = sp;
+			on_sparse = on;
+			dens = ds;
+		}
+		else
+		{
+			sparse.clear();
+			on_sparse.clear();
+			dens = std::valarray<double>();
+		}
+		bump_version();
+	}
+	// 稀疏存储的层导出时展开成稠密矩阵
+	virtual void export_weight_to(vmxtype& w) const override
+	{
+		if (w.size() != weight.size()) w.resize(weight.size());
+		for (size_t i = 0; i < weight.size(); i++) w[i] = use_sparse(i) ? mxtype(sparse[i]) : weight[i];
+	}
+
+	// 替换参数后同样要应用 mask
+	virtual void set_param(const vmxtype& w, const vmxtype& b) override
+	{
+		densify();
+		try { MLP<_Value>::set_param(w, b); }
+		catch (...) { if (!mask.empty()) apply_mask(); throw; }
+		if (!mask.empty()) apply_mask();
+	}
+};
+
+// 剪枝前后的速度和内存对比
+struct prune_stat
+{
+	double density; // 密度
+	double dense_ns, sparse_ns; // 稠密/稀疏矩阵乘列向量一次的平均耗时（纳秒）
+	size_t dense_bytes, sparse_bytes; // 占用内存（字节）
+};
+/// <summary>
+/// 测量 n x m 的权重矩阵在不同密度下，稠密乘法与稀疏乘法的耗时和内存，用于选择 sparse_cutover
+/// </summary>
+/// <param name="n">行数（输出层大小）</param>
+/// <param name="m">列数（输入层大小）</param>
+/// <param name="densities">要测的密度</param>
+/// <param name="repeat">每个密度重复的次数</param>
+template<typename _Value = long double>
+std::vector<prune_stat> prune_profile(size_t n, size_t m, const std::vector<double>& densities, unsigned repeat = 100)
+{
+	std::mt19937_64 mt(n * 1000003 + m);
+	std::uniform_real_distribution<double> u(0, 1);
+	type_matrix<_Value> x(m, 1);
+	for (auto& p : x) p = _Value(u(mt));
+	std::vector<prune_stat> res;
+	for (double d : densities)
+	{
+		type_matrix<_Value> w(n, m);
+		for (auto& p : w) p = u(mt) < d ? _Value(u(mt) - 0.5) : _Value();
+		sparse_matrix<_Value> sw(w);
+		auto timeit = [&](const auto& mat) {
+			_Value sink{};
+			auto st = std::chrono::steady_clock::now();
+			for (unsigned r = 0; r < repeat; r++) sink += (mat * x)[0][0];
+			auto ed = std::chrono::steady_clock::now();
+			volatile _Value keep = sink; (void)keep;
+			return std::chrono::duration<double, std::nano>(ed - st).count() / std::max(repeat, 1u);
+		};
+		res.push_back({ sw.density(), timeit(w), timeit(sw), n * m * sizeof(_Value), sw.memory_bytes() });
+	}
+	return res;
+}
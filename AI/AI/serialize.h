@@ -0,0 +1,98 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "matrix.h"
+
+// 二进制序列化：把数值和矩阵按内存中的表示追加到 std::string 末尾，或从中顺序读出
+// 检查点（checkpoint.h）和各模型的 export_params / import_params 使用
+namespace binary_io
+{
+	template<typename T>
+	void put(std::string& buf, const T& x) { buf.append(reinterpret_cast<const char*>(&x), sizeof(T)); }
+	inline void put_string(std::string& buf, const std::string& s)
+	{
+		put<uint64_t>(buf, s.size());
+		buf.append(s);
+	}
+	// 行数、列数，然后逐行复制（每一行在内存中是连续的）
+	template<typename _Valt>
+	void put_matrix(std::string& buf, const type_matrix<_Valt>& mx)
+	{
+		auto [n, m] = mx.size();
+		put<uint64_t>(buf, n);
+		put<uint64_t>(buf, m);
+		if (m == 0) return;
+		for (size_t i = 0; i < n; i++) buf.append(reinterpret_cast<const char*>(&mx[i][0]), m * sizeof(_Valt));
+	}
+	template<typename T>
+	void put_vector(std::string& buf, const std::vector<T>& v)
+	{
+		put<uint64_t>(buf, v.size());
+		if (!v.empty()) buf.append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+	}
+	template<typename _Valt>
+	void put_matrices(std::string& buf, const std::vector<type_matrix<_Valt>>& v)
+	{
+		put<uint64_t>(buf, v.size());
+		for (const auto& mx : v) put_matrix(buf, mx);
+	}
+
+	// 顺序读取，越界则失败（返回 false）
+	struct reader
+	{
+		const std::string& s;
+		size_t pos = 0;
+		size_t remain() const { return s.size() - pos; }
+		template<typename T>
+		bool get(T& x) { if (sizeof(T) > remain()) return false; std::memcpy(&x, s.data() + pos, sizeof(T)); pos += sizeof(T); return true; }
+		bool get_string(std::string& x)
+		{
+			uint64_t len;
+			if (!get(len) || len > remain()) return false;
+			x = s.substr(pos, len);
+			pos += len;
+			return true;
+		}
+		template<typename T>
+		bool get_vector(std::vector<T>& v)
+		{
+			uint64_t cnt;
+			if (!get(cnt) || cnt > remain() / sizeof(T)) return false;
+			v.resize(cnt);
+			if (cnt != 0) std::memcpy(v.data(), s.data() + pos, cnt * sizeof(T));
+			pos += cnt * sizeof(T);
+			return true;
+		}
+		// 读一个字符串并判断是否等于 tag
+		bool expect(const std::string& tag)
+		{
+			std::string x;
+			return get_string(x) && x == tag;
+		}
+		template<typename _Valt>
+		bool get_matrix(type_matrix<_Valt>& mx)
+		{
+			uint64_t n, m;
+			if (!get(n) || !get(m) || (m != 0 && n > remain() / m / sizeof(_Valt))) return false;
+			if (mx.size() != std::pair<size_t, size_t>(n, m)) mx.resize(n, m);
+			if (m == 0) return true;
+			for (size_t i = 0; i < n; i++)
+			{
+				std::memcpy(&mx[i][0], s.data() + pos, m * sizeof(_Valt));
+				pos += m * sizeof(_Valt);
+			}
+			return true;
+		}
+		template<typename _Valt>
+		bool get_matrices(std::vector<type_matrix<_Valt>>& v)
+		{
+			uint64_t cnt;
+			if (!get(cnt) || cnt > remain()) return false;
+			v.resize(cnt);
+			for (auto& mx : v) if (!get_matrix(mx)) return false;
+			return true;
+		}
+	};
+}
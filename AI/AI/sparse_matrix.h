@@ -0,0 +1,153 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "matrix.h"
+#include "serialize.h"
+
+// 稀疏矩阵，压缩稀疏行（CSR）格式：只保存非零元素
+// 第 i 行的非零元素为 val[row_ptr[i] .. row_ptr[i + 1])，所在列为 col 中对应位置
+template<typename _Valt>
+class sparse_matrix
+{
+private:
+	size_t n, m;
+	std::vector<size_t> row_ptr;
+	std::vector<uint32_t> col;
+	std::vector<_Valt> val;
+public:
+	// 默认构造函数，空矩阵
+	sparse_matrix() : n(0), m(0), row_ptr(1, 0) {}
+	// 从稠密矩阵构造，丢掉所有的 0
+	explicit sparse_matrix(const type_matrix<_Valt>& x) : n(x.size().first), m(x.size().second)
+	{
+		if (m > UINT32_MAX) throw std::length_error("Error in sparse_matrix::sparse_matrix: The matrix has too many columns.");
+		row_ptr.reserve(n + 1);
+		row_ptr.push_back(0);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = 0; j < m; j++)
+			{
+				if (x[i][j] != _Valt()) { col.push_back(uint32_t(j)); val.push_back(x[i][j]); }
+			}
+			row_ptr.push_back(val.size());
+		}
+	}
+
+	// 从稠密矩阵构造，只保留 mask 不为 0 的位置（即使值为 0 也保留）
+	sparse_matrix(const type_matrix<_Valt>& x, const type_matrix<_Valt>& mask) : n(x.size().first), m(x.size().second)
+	{
+		if (mask.size() != x.size()) throw std::invalid_argument("Error in sparse_matrix::sparse_matrix: The mask should have the same size as the matrix.");
+		if (m > UINT32_MAX) throw std::length_error("Error in sparse_matrix::sparse_matrix: The matrix has too many columns.");
+		row_ptr.reserve(n + 1);
+		row_ptr.push_back(0);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = 0; j < m; j++)
+			{
+				if (mask[i][j] != _Valt()) { col.push_back(uint32_t(j)); val.push_back(x[i][j]); }
+			}
+			row_ptr.push_back(val.size());
+		}
+	}
+
+	// 求大小
+	std::pair<size_t, size_t> size() const { return { n, m }; }
+	// 非零元素个数
+	size_t nnz() const { return val.size(); }
+	// 密度（非零元素所占比例）
+	double density() const { return n * m == 0 ? 0 : double(nnz()) / (n * m); }
+	// 占用的内存（字节）
+	size_t memory_bytes() const { return val.size() * (sizeof(_Valt) + sizeof(uint32_t)) + row_ptr.size() * sizeof(size_t); }
+	// 所有保存的元素
+	const std::vector<_Valt>& values() const { return val; }
+	// 稀疏结构：保存了元素的位置为 1，其余为 0
+	type_matrix<_Valt> pattern() const
+	{
+		type_matrix<_Valt> res(n, m);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t k = row_ptr[i]; k < row_ptr[i + 1]; k++) res[i][col[k]] = 1;
+		}
+		return res;
+	}
+	// 只在保存了元素的位置加上 s * d，稀疏结构不变（剪枝后微调用）
+	void add_scaled(const _Valt& s, const type_matrix<_Valt>& d)
+	{
+		if (d.size() != size()) throw std::invalid_argument("Error in sparse_matrix::add_scaled: The size of d should be the same as the matrix.");
+		parallel_rows(n, nnz() / std::max<size_t>(n, 1), [&](size_t i) {
+			for (size_t k = row_ptr[i]; k < row_ptr[i + 1]; k++) val[k] += s * d[i][col[k]];
+		});
+	}
+	// 序列化（检查点用）
+	void save(std::string& buf) const
+	{
+		binary_io::put<uint64_t>(buf, n);
+		binary_io::put<uint64_t>(buf, m);
+		binary_io::put_vector(buf, row_ptr);
+		binary_io::put_vector(buf, col);
+		binary_io::put_vector(buf, val);
+	}
+	// 反序列化，数据不合法时返回 false，且不修改矩阵
+	bool load(binary_io::reader& rd)
+	{
+		uint64_t nn, mm;
+		std::vector<size_t> rp;
+		std::vector<uint32_t> cl;
+		std::vector<_Valt> vl;
+		if (!rd.get(nn) || !rd.get(mm) || !rd.get_vector(rp) || !rd.get_vector(cl) || !rd.get_vector(vl)) return false;
+		if (rp.empty() || rp.size() - 1 != nn || rp[0] != 0 || rp.back() != vl.size() || cl.size() != vl.size()) return false;
+		for (size_t i = 0; i < nn; i++) if (rp[i] > rp[i + 1]) return false;
+		for (auto c : cl) if (c >= mm) return false;
+		n = nn;
+		m = mm;
+		row_ptr = std::move(rp);
+		col = std::move(cl);
+		val = std::move(vl);
+		return true;
+	}
+	// 转回稠密矩阵
+	operator type_matrix<_Valt>() const
+	{
+		type_matrix<_Valt> res(n, m);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t k = row_ptr[i]; k < row_ptr[i + 1]; k++) res[i][col[k]] = val[k];
+		}
+		return res;
+	}
+
+	// 稀疏矩阵乘稠密矩阵（SpMM，y 为列向量时即 SpMV），按行并行
+	friend type_matrix<_Valt> operator*(const sparse_matrix& x, const type_matrix<_Valt>& y)
+	{
+		if (x.m != y.size().first) throw std::invalid_argument("Error in operator*(const sparse_matrix &, const type_matrix &): The columns of the matrix x and the rows of y should be the same.");
+		size_t p = y.size().second;
+		type_matrix<_Valt> res(x.n, p);
+		parallel_rows(x.n, x.nnz() / std::max<size_t>(x.n, 1) * p, [&](size_t i) {
+			for (size_t k = x.row_ptr[i]; k < x.row_ptr[i + 1]; k++)
+			{
+				_Valt v = x.val[k];
+				size_t c = x.col[k];
+				for (size_t j = 0; j < p; j++) res[i][j] += v * y[c][j];
+			}
+		});
+		return res;
+	}
+	// 转置后乘稠密矩阵 x^T * y（反向传播用）
+	type_matrix<_Valt> transpose_mul(const type_matrix<_Valt>& y) const
+	{
+		if (n != y.size().first) throw std::invalid_argument("Error in sparse_matrix::transpose_mul: The rows of the matrix and y should be the same.");
+		size_t p = y.size().second;
+		type_matrix<_Valt> res(m, p);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t k = row_ptr[i]; k < row_ptr[i + 1]; k++)
+			{
+				_Valt v = val[k];
+				size_t c = col[k];
+				for (size_t j = 0; j < p; j++) res[c][j] += v * y[i][j];
+			}
+		}
+		return res;
+	}
+};
@@ -0,0 +1,190 @@
+#pragma once
+#include <array>
+#include <tuple>
+#include <utility>
+#include "MLP.h"
+#include "static_matrix.h"
+
+// 固定结构的多层感知器
+// 层大小在编译期给出，权重存放在 static_matrix 里，整个网络都在栈上；
+// 前向/反向传播中的循环全部展开（见 unroll_for），激活函数为函数对象（见 activate_func::*_f），没有 std::function 和堆分配。
+// 适合每层不超过 static_unroll_limit 个神经元的小网络。损失函数固定为 MSE，与 MLP 的默认值一致。
+namespace static_mlp_impl
+{
+	// 取参数包中第 _I 个大小
+	template<size_t _I, size_t... _S>
+	constexpr size_t nth_size = std::array<size_t, sizeof...(_S)>{ _S... }[_I];
+
+	// 第 i 层（i >= 1）的权重为 size[i] x size[i - 1]，偏置为 size[i]；下标从 0 开始存放
+	template<typename _Value, typename _Seq, size_t... _S>
+	struct layer_types;
+	template<typename _Value, size_t... _I, size_t... _S>
+	struct layer_types<_Value, std::index_sequence<_I...>, _S...>
+	{
+		using weight_type = std::tuple<static_matrix<_Value, nth_size<_I + 1, _S...>, nth_size<_I, _S...>>...>;
+		using bias_type = std::tuple<std::array<_Value, nth_size<_I + 1, _S...>>...>;
+	};
+	// 每一层（包括输入层）的 a 或 z
+	template<typename _Value, size_t... _S>
+	using value_type = std::tuple<std::array<_Value, _S>...>;
+}
+
+template<typename _Act, typename _Value, size_t... _Sizes>
+class basic_static_mlp
+{
+	static_assert(sizeof...(_Sizes) >= 2, "The static_mlp should contain at least two layers(the input layer and the output layer).");
+public:
+	static constexpr size_t layers = sizeof...(_Sizes); // 层数（包括输入层、输出层和隐藏层）
+	static constexpr std::array<size_t, layers> size = { _Sizes... }; // 神经元层大小
+	using input_type = std::array<_Value, size[0]>;
+	using output_type = std::array<_Value, size[layers - 1]>;
+	using weight_type = typename static_mlp_impl::layer_types<_Value, std::make_index_sequence<layers - 1>, _Sizes...>::weight_type;
+	using bias_type = typename static_mlp_impl::layer_types<_Value, std::make_index_sequence<layers - 1>, _Sizes...>::bias_type;
+	// 单次训练的结果（dw, db），含义与 MLP::train 相同
+	struct grad_type
+	{
+		weight_type dw;
+		bias_type db;
+	};
+private:
+	using value_type = static_mlp_impl::value_type<_Value, _Sizes...>;
+	weight_type weight;
+	bias_type bias;
+	_Act act; // 激活函数（函数对象）
+
+	// 对每一层 i = 1 .. layers - 1 调用 f(integral_constant<i>)
+	template<typename _Fun>
+	static void for_layers(const _Fun& f)
+	{
+		[&]<size_t... _I>(std::index_sequence<_I...>) { (f(std::integral_constant<size_t, _I + 1>{}), ...); }(std::make_index_sequence<layers - 1>{});
+	}
+	// 同上，倒序
+	template<typename _Fun>
+	static void for_layers_reverse(const _Fun& f)
+	{
+		[&]<size_t... _I>(std::index_sequence<_I...>) { (f(std::integral_constant<size_t, layers - 1 - _I>{}), ...); }(std::make_index_sequence<layers - 1>{});
+	}
+	// 前向传播，求出每一层的 a 和 z
+	void forward(const input_type& in, value_type& a, value_type& z) const
+	{
+		std::get<0>(a) = in;
+		std::get<0>(z) = in;
+		for_layers([&](auto i) {
+			auto& zi = std::get<i>(z);
+			auto& ai = std::get<i>(a);
+			zi = static_affine(std::get<i - 1>(weight), std::get<i - 1>(a), std::get<i - 1>(bias));
+			unroll_for<size[i]>([&](size_t j) { ai[j] = act(zi[j]); });
+		});
+	}
+	// 反向传播（损失函数 MSE），对每一层调用 on_grad(i, ae[i], da[i], a[i - 1])，返回损失
+	// on_grad 在求出第 i - 1 层的 da 之后才被调用，所以可以在其中直接修改第 i 层的权重
+	template<typename _Fun>
+	_Value backward(const input_type& in, const output_type& out, const _Fun& on_grad) const
+	{
+		value_type a, z, da;
+		forward(in, a, z);
+		constexpr size_t last = layers - 1;
+		const auto& p = std::get<last>(a);
+		_Value loss{};
+		unroll_for<size[last]>([&](size_t j) {
+			_Value r = p[j] - out[j];
+			loss += r * r;
+			std::get<last>(da)[j] = 2 * r / size[last];
+		});
+		loss /= size[last];
+		for_layers_reverse([&](auto i) {
+			std::array<_Value, size[i]> ae;
+			unroll_for<size[i]>([&](size_t j) { ae[j] = std::get<i>(da)[j] * act.d(std::get<i>(z)[j]); });
+			if constexpr (i > 1) std::get<i - 1>(da) = static_rotate_mul(std::get<i - 1>(weight), ae);
+			on_grad(i, ae, std::get<i>(da), std::get<i - 1>(a));
+		});
+		return loss;
+	}
+public:
+	// 随机初始化（与 MLP 的默认初始化相同：Xavier 高斯分布权重，零偏置）
+	basic_static_mlp(const _Act& acf = _Act()) : weight{}, bias{}, act(acf)
+	{
+		for_layers([&](auto i) {
+			for (auto& p : std::get<i - 1>(weight)) p = init_func::Xavier_gauss_once<_Value>(size[i - 1], size[i]);
+		});
+	}
+	// 从 MLP 导入权重
+	template<typename _Vt>
+	explicit basic_static_mlp(const MLP<_Vt>& mlp, const _Act& acf = _Act()) : weight{}, bias{}, act(acf) { load(mlp); }
+
+	// 从 MLP 导入权重和偏置，两者层大小必须完全一致
+	template<typename _Vt>
+	void load(const MLP<_Vt>& mlp)
+	{
+		const auto& sz = mlp.get_size();
+		if (sz.size() != layers) throw std::invalid_argument("Error in static_mlp::load: The MLP has " + std::to_string(sz.size()) + " layers, but the static_mlp has " + std::to_string(layers) + ".");
+		for (size_t i = 0; i < layers; i++)
+		{
+			if (sz[i] != size[i]) throw std::invalid_argument("Error in static_mlp::load: The size of layer " + std::to_string(i) + " of the MLP is " + std::to_string(sz[i]) + ", but it should be " + std::to_string(size[i]) + ".");
+		}
+		const auto w = mlp.export_weight();
+		const auto& b = mlp.get_bias();
+		for_layers([&](auto i) {
+			for (size_t j = 0; j < size[i]; j++)
+			{
+				for (size_t k = 0; k < size[i - 1]; k++)
+				{
+					std::get<i - 1>(weight)(j, k) = w[i][j][k];
+				}
+				std::get<i - 1>(bias)[j] = b[i][j][0];
+			}
+		});
+	}
+	// 前向传播，只返回输出层
+	output_type get(const input_type& in) const
+	{
+		value_type a, z;
+		forward(in, a, z);
+		return std::get<layers - 1>(a);
+	}
+	/// <summary>
+	/// 获取单次训练结果，与 MLP::train 相同
+	/// </summary>
+	/// <param name="in">输入</param>
+	/// <param name="out">正确输出</param>
+	std::pair<_Value, grad_type> train(const input_type& in, const output_type& out) const
+	{
+		grad_type g{};
+		_Value loss = backward(in, out, [&](auto i, const auto& ae, const auto& da, const auto& ap) {
+			static_outer_add(std::get<i - 1>(g.dw), _Value(1), ae, ap);
+			std::get<i - 1>(g.db) = da;
+		});
+		return { loss, g };
+	}
+	/// <summary>
+	/// 应用训练结果
+	/// </summary>
+	/// <param name="beta">学习率</param>
+	/// <param name="g">train 的结果</param>
+	void apply_train(const _Value& beta, const grad_type& g)
+	{
+		for_layers([&](auto i) {
+			auto& w = std::get<i - 1>(weight);
+			const auto& dw = std::get<i - 1>(g.dw);
+			unroll_for<size[i]>([&](size_t j) {
+				unroll_for<size[i - 1]>([&](size_t k) { w(j, k) -= beta * dw(j, k); });
+				std::get<i - 1>(bias)[j] -= beta * std::get<i - 1>(g.db)[j];
+			});
+		});
+	}
+	// 训练并立即应用，不保存中间的 dw 和 db
+	_Value train_and_apply(const _Value& beta, const input_type& in, const output_type& out)
+	{
+		return backward(in, out, [&](auto i, const auto& ae, const auto& da, const auto& ap) {
+			static_outer_add(std::get<i - 1>(weight), -beta, ae, ap);
+			unroll_for<size[i]>([&](size_t j) { std::get<i - 1>(bias)[j] -= beta * da[j]; });
+		});
+	}
+	void set_acf(const _Act& acf = _Act()) { act = acf; }
+	const weight_type& get_weight() const { return weight; }
+	const bias_type& get_bias() const { return bias; }
+};
+
+// 默认激活函数与 MLP 相同（Leaky PReLU, a = 0.01）
+template<typename _Value, size_t... _Sizes>
+using static_mlp = basic_static_mlp<activate_func::Leaky_PReLU_f<_Value>, _Value, _Sizes...>;
@@ -0,0 +1,113 @@
+#pragma once
+#include <array>
+#include <string>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include "matrix.h"
+
+// 编译期展开上限：长度不超过它的循环完全展开，超过则退回普通 for 循环（防止编译时间爆炸）
+constexpr size_t static_unroll_limit = 64;
+
+// 编译期完全展开的循环，依次调用 f(0), f(1), ..., f(_N - 1)
+template<size_t _N, typename _Fun>
+constexpr void unroll_for(const _Fun& f)
+{
+	if constexpr (_N <= static_unroll_limit)
+	{
+		[&]<size_t... _I>(std::index_sequence<_I...>) { (f(_I), ...); }(std::make_index_sequence<_N>{});
+	}
+	else
+	{
+		for (size_t i = 0; i < _N; i++) f(i);
+	}
+}
+
+// 固定大小矩阵，行列数均为编译期常量，数据放在 std::array 里（行优先），整个对象在栈上
+template<typename _Valt, size_t _N, size_t _M>
+class static_matrix
+{
+private:
+	std::array<_Valt, _N * _M> _Val{};
+public:
+	static constexpr size_t rows = _N, cols = _M;
+	// 默认构造函数，全零矩阵
+	constexpr static_matrix() = default;
+	// 从 type_matrix 构造，大小必须一致
+	explicit static_matrix(const type_matrix<_Valt>& x) { assign(x); }
+
+	// 求大小（与 type_matrix::size 保持一致）
+	static constexpr std::pair<size_t, size_t> size() { return { _N, _M }; }
+	// 求元素
+	constexpr _Valt& operator()(size_t x, size_t y) { return _Val[x * _M + y]; }
+	constexpr const _Valt& operator()(size_t x, size_t y) const { return _Val[x * _M + y]; }
+	// 按行取元素，m[i][j] 的写法和 type_matrix 相同
+	constexpr _Valt* operator[](size_t x) { return _Val.data() + x * _M; }
+	constexpr const _Valt* operator[](size_t x) const { return _Val.data() + x * _M; }
+	// 遍历所有元素
+	constexpr auto begin() { return _Val.begin(); }
+	constexpr auto begin() const { return _Val.begin(); }
+	constexpr auto end() { return _Val.end(); }
+	constexpr auto end() const { return _Val.end(); }
+
+	// 从 type_matrix 复制
+	void assign(const type_matrix<_Valt>& x)
+	{
+		if (x.size() != size()) throw std::invalid_argument("Error in static_matrix::assign: The size of the type_matrix should be " + std::to_string(_N) + "x" + std::to_string(_M) + ", but it is " + std::to_string(x.size().first) + "x" + std::to_string(x.size().second) + ".");
+		for (size_t i = 0; i < _N; i++)
+		{
+			for (size_t j = 0; j < _M; j++)
+			{
+				(*this)(i, j) = x[i][j];
+			}
+		}
+	}
+	// 类型转换
+	operator type_matrix<_Valt>() const
+	{
+		type_matrix<_Valt> res(_N, _M);
+		for (size_t i = 0; i < _N; i++)
+		{
+			for (size_t j = 0; j < _M; j++)
+			{
+				res[i][j] = (*this)(i, j);
+			}
+		}
+		return res;
+	}
+};
+
+// 固定大小矩阵的运算（全部展开）
+namespace
+{
+	// res = w * x + b
+	template<typename _Valt, size_t _N, size_t _M>
+	constexpr std::array<_Valt, _N> static_affine(const static_matrix<_Valt, _N, _M>& w, const std::array<_Valt, _M>& x, const std::array<_Valt, _N>& b)
+	{
+		// 按列累加而不是按行求内积：每行各自累加，没有长的加法依赖链，便于编译器向量化
+		std::array<_Valt, _N> res = b;
+		unroll_for<_M>([&](size_t j) {
+			unroll_for<_N>([&](size_t i) { res[i] += w(i, j) * x[j]; });
+		});
+		return res;
+	}
+	// res = rotate(w) * x
+	template<typename _Valt, size_t _N, size_t _M>
+	constexpr std::array<_Valt, _M> static_rotate_mul(const static_matrix<_Valt, _N, _M>& w, const std::array<_Valt, _N>& x)
+	{
+		std::array<_Valt, _M> res{};
+		unroll_for<_N>([&](size_t i) {
+			unroll_for<_M>([&](size_t j) { res[j] += w(i, j) * x[i]; });
+		});
+		return res;
+	}
+	// w += k * x * rotate(y)（外积累加）
+	template<typename _Valt, size_t _N, size_t _M>
+	constexpr void static_outer_add(static_matrix<_Valt, _N, _M>& w, const _Valt& k, const std::array<_Valt, _N>& x, const std::array<_Valt, _M>& y)
+	{
+		unroll_for<_N>([&](size_t i) {
+			_Valt kx = k * x[i];
+			unroll_for<_M>([&](size_t j) { w(i, j) += kx * y[j]; });
+		});
+	}
+}
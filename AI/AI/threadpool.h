@@ -0,0 +1,186 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// 全局共享的工作窃取线程池，供矩阵运算做算子内并行
+// 每个工作线程有自己的任务队列：从自己的队尾取任务，空了就从别的线程的队首偷任务。
+// 调用 parallel_for 的线程自己也参与计算，等待时会帮忙执行队列中的任务，所以嵌套调用不会死锁。
+class thread_pool
+{
+private:
+	struct task_queue
+	{
+		std::mutex mtx;
+		std::deque<std::function<void()>> q;
+	};
+	std::vector<std::unique_ptr<task_queue>> queues;
+	std::vector<std::thread> workers;
+	std::vector<int> cpus; // 绑定的 CPU 编号（为空则不绑定）
+	std::atomic<bool> stop{ false };
+	std::atomic<size_t> queued{ 0 }; // 所有队列中的任务总数
+	std::atomic<size_t> next{ 0 }; // 外部线程提交任务时轮流放入各队列
+	std::mutex wake_mtx;
+	std::condition_variable wake_cv;
+	// 当前线程在哪个线程池里是第几个工作线程
+	static inline thread_local const thread_pool* tl_pool = nullptr;
+	static inline thread_local size_t tl_index = 0;
+
+	static void pin(std::thread& t, int cpu)
+	{
+#ifdef _WIN32
+		SetThreadAffinityMask(t.native_handle(), DWORD_PTR(1) << cpu);
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#else
+		(void)t; (void)cpu;
+#endif
+	}
+	void push(std::function<void()> f)
+	{
+		size_t id = tl_pool == this ? tl_index : next++ % queues.size();
+		{
+			std::lock_guard<std::mutex> lk(queues[id]->mtx);
+			queues[id]->q.push_back(std::move(f));
+		}
+		queued++;
+		// 先拿一次锁再通知，防止工作线程在检查 queued 之后、wait 之前错过通知
+		{ std::lock_guard<std::mutex> lk(wake_mtx); }
+		wake_cv.notify_one();
+	}
+	// 取一个任务：先看自己的队列（队尾），再从别人那里偷（队首）
+	bool try_pop(size_t self, std::function<void()>& f)
+	{
+		size_t n = queues.size();
+		for (size_t k = 0; k < n; k++)
+		{
+			size_t id = (self + k) % n;
+			std::lock_guard<std::mutex> lk(queues[id]->mtx);
+			auto& q = queues[id]->q;
+			if (q.empty()) continue;
+			if (k == 0) { f = std::move(q.back()); q.pop_back(); }
+			else { f = std::move(q.front()); q.pop_front(); }
+			queued--;
+			return true;
+		}
+		return false;
+	}
+	bool run_one(size_t self)
+	{
+		std::function<void()> f;
+		if (!try_pop(self, f)) return false;
+		f();
+		return true;
+	}
+	void worker_loop(size_t id)
+	{
+		tl_pool = this;
+		tl_index = id;
+		while (true)
+		{
+			if (run_one(id)) continue;
+			std::unique_lock<std::mutex> lk(wake_mtx);
+			wake_cv.wait(lk, [this] { return stop || queued > 0; });
+			if (stop && queued == 0) return;
+		}
+	}
+	void start(size_t n)
+	{
+		stop = false;
+		queues.clear();
+		// 至少一个队列，供调用线程使用；工作线程数为 n - 1（调用线程算一个）
+		for (size_t i = 0; i < std::max<size_t>(n, 1); i++) queues.push_back(std::make_unique<task_queue>());
+		for (size_t i = 1; i < n; i++)
+		{
+			workers.emplace_back(&thread_pool::worker_loop, this, i);
+			if (!cpus.empty()) pin(workers.back(), cpus[i % cpus.size()]);
+		}
+	}
+	void shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lk(wake_mtx);
+			stop = true;
+		}
+		wake_cv.notify_all();
+		for (auto& t : workers) t.join();
+		workers.clear();
+	}
+public:
+	// n 为参与计算的线程总数（包括调用线程），0 表示使用全部硬件线程
+	explicit thread_pool(size_t n = 0) { start(n == 0 ? std::max(1u, std::thread::hardware_concurrency()) : n); }
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+	~thread_pool() { shutdown(); }
+
+	// 矩阵运算使用的全局线程池
+	static thread_pool& global() { static thread_pool pool; return pool; }
+
+	// 参与计算的线程总数
+	size_t size() const { return queues.size(); }
+	// 重新设置线程数，不能在有任务执行时调用
+	void set_threads(size_t n)
+	{
+		shutdown();
+		start(n == 0 ? std::max(1u, std::thread::hardware_concurrency()) : n);
+	}
+	// 把第 i 个工作线程绑定到 cpu[i % cpu.size()]，传入空表则不再绑定（已绑定的线程重建后恢复默认），不能在有任务执行时调用
+	void set_affinity(const std::vector<int>& cpu)
+	{
+		cpus = cpu;
+		set_threads(size());
+	}
+
+	/// <summary>
+	/// 把 [begin, end) 切成长度不小于 grain 的若干段并行执行 f(l, r)，所有段完成后返回
+	/// 任何一段抛出的异常会在调用线程重新抛出
+	/// </summary>
+	template<typename _Fun>
+	void parallel_for(size_t begin, size_t end, size_t grain, const _Fun& f)
+	{
+		if (begin >= end) return;
+		size_t len = end - begin;
+		size_t parts = std::min(size() * 4, (len + std::max<size_t>(grain, 1) - 1) / std::max<size_t>(grain, 1));
+		if (parts <= 1 || size() == 1) { f(begin, end); return; }
+		size_t step = (len + parts - 1) / parts;
+		parts = (len + step - 1) / step;
+		std::atomic<size_t> remain{ parts - 1 };
+		std::exception_ptr err;
+		std::mutex err_mtx;
+		auto run = [&](size_t l, size_t r) {
+			try { f(l, r); }
+			catch (...) { std::lock_guard<std::mutex> lk(err_mtx); if (!err) err = std::current_exception(); }
+		};
+		for (size_t i = 1; i < parts; i++)
+		{
+			size_t l = begin + i * step, r = std::min(end, l + step);
+			push([&run, &remain, l, r] { run(l, r); remain--; });
+		}
+		run(begin, std::min(end, begin + step));
+		size_t self = tl_pool == this ? tl_index : 0;
+		while (remain > 0)
+		{
+			if (!run_one(self)) std::this_thread::yield();
+		}
+		if (err) std::rethrow_exception(err);
+	}
+};